@@ -0,0 +1,79 @@
+// arena.hpp
+#ifndef ARENA_HPP // Prevents multiple inclusion of this header file
+#define ARENA_HPP
+
+#include <vector>      // For std::vector
+#include <new>         // For placement new and ::operator new
+#include <cstddef>     // For std::size_t
+#include <utility>     // For std::forward and std::swap
+
+// Arena class allocates objects of one type from a few large slabs instead of one heap
+// block each. Objects live until the arena is destroyed, which destroys them with a flat
+// loop (no recursion, whatever links they hold) and releases each slab with one call.
+// Slabs double in size from MIN_SLAB up to MAX_SLAB objects, so small arenas stay small.
+// Objects never move, so pointers to them stay valid for the arena's lifetime. To free
+// some objects, build a new arena holding the survivors and swap it in.
+template <typename T>
+class Arena {
+private:
+    static constexpr std::size_t MIN_SLAB = 4;    // Objects in the first slab
+    static constexpr std::size_t MAX_SLAB = 1024; // Largest slab in objects
+
+    // Slab is one block of raw storage for cap objects, the first used of them constructed
+    struct Slab {
+        T* items;
+        std::size_t used;
+        std::size_t cap;
+    };
+
+    std::vector<Slab> slabs; // Slabs in allocation order; only the last has free space
+    std::size_t count;       // Live objects across all slabs
+
+public:
+    Arena() : count(0) {}
+
+    // Destructor: destroys every object, then releases the slabs
+    ~Arena() {
+        for (auto& s : slabs) {
+            for (std::size_t i = 0; i < s.used; i++) {s.items[i].~T();}
+            ::operator delete(s.items);
+        }
+    }
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    // Constructs a new object in the arena and returns a pointer to it
+    template <typename... Args>
+    T* create(Args&&... args) {
+        if (slabs.empty() || slabs.back().used == slabs.back().cap) {
+            std::size_t cap = slabs.empty() ? MIN_SLAB : slabs.back().cap * 2;
+            if (cap > MAX_SLAB) cap = MAX_SLAB;
+            slabs.reserve(slabs.size() + 1); // So push_back cannot throw after allocating
+            slabs.push_back(Slab{static_cast<T*>(::operator new(cap * sizeof(T))), 0, cap});
+        }
+        Slab& s = slabs.back();
+        T* obj = new (s.items + s.used) T(std::forward<Args>(args)...);
+        s.used++;
+        count++;
+        return obj;
+    }
+
+    // Exchanges the contents of two arenas; no object moves
+    void swap(Arena& other) {
+        slabs.swap(other.slabs);
+        std::swap(count, other.count);
+    }
+
+    // Returns the number of objects in the arena
+    std::size_t size() const {return count;}
+
+    // Returns the bytes reserved by the arena's slabs
+    std::size_t capacity_bytes() const {
+        std::size_t total = 0;
+        for (const auto& s : slabs) total += s.cap * sizeof(T);
+        return total;
+    }
+};
+
+#endif // End of include guard
@@ -0,0 +1,99 @@
+// args.hpp
+#ifndef ARGS_HPP // Prevents multiple inclusion of this header file
+#define ARGS_HPP
+
+#include <string>      // For std::string
+#include <cstddef>     // For std::size_t
+#include <climits>     // For INT_MAX and INT_MIN
+
+// Slice is a non-owning view of a byte range (C++11 has no std::string_view)
+struct Slice {
+    const char* p;   // First byte
+    std::size_t n;   // Number of bytes
+
+    Slice() : p(""), n(0) {}
+    Slice(const char* data, std::size_t len) : p(data), n(len) {}
+
+    bool empty() const {return n == 0;}
+    std::string str() const {return std::string(p, n);}
+    // Assigns the slice to s, reusing its buffer
+    void assign_to(std::string& s) const {s.assign(p, n);}
+};
+
+// Args tokenizes one command line in place, without allocating. It reproduces the
+// std::stringstream extractions the handlers were written against: word() behaves like
+// `ss >> std::string`, integer() like `ss >> int` and rest() like `std::getline(ss, s)`,
+// including the sticky failure state after an extraction fails.
+class Args {
+private:
+    const char* cur;  // Next unread byte
+    const char* end;  // End of the line
+    bool failed;      // Set once an extraction fails; later extractions fail too
+
+    static bool is_space(char c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+    }
+    void skip_space() {
+        while (cur < end && is_space(*cur)) cur++;
+    }
+
+public:
+    explicit Args(Slice line) : cur(line.p), end(line.p + line.n), failed(false) {}
+
+    // Extracts the next whitespace-delimited word; false if none is left
+    bool word(Slice& out) {
+        if (failed) return false;
+        skip_space();
+        if (cur == end) {failed = true; return false;}
+        const char* start = cur;
+        while (cur < end && !is_space(*cur)) cur++;
+        out = Slice(start, cur - start);
+        return true;
+    }
+    // Extracts the next word into a string
+    bool word(std::string& out) {
+        Slice s;
+        if (!word(s)) return false;
+        s.assign_to(out);
+        return true;
+    }
+
+    // Extracts a signed decimal integer. Like operator>>, leaves v untouched at end of
+    // line, stores 0 when the next word is not a number and clamps on overflow (failing).
+    bool integer(int& v) {
+        if (failed) return false;
+        skip_space();
+        if (cur == end) {failed = true; return false;}
+        bool neg = false;
+        if (*cur == '+' || *cur == '-') neg = (*cur++ == '-');
+        if (cur == end || *cur < '0' || *cur > '9') {failed = true; v = 0; return false;}
+        long long x = 0;
+        bool overflow = false;
+        while (cur < end && *cur >= '0' && *cur <= '9') {
+            if (!overflow) {
+                x = x * 10 + (*cur - '0');
+                if (x > static_cast<long long>(INT_MAX) + 1) overflow = true;
+            }
+            cur++;
+        }
+        if (neg) x = -x;
+        if (overflow || x > INT_MAX || x < INT_MIN) {
+            failed = true;
+            v = neg ? INT_MIN : INT_MAX;
+            return false;
+        }
+        v = static_cast<int>(x);
+        return true;
+    }
+
+    // Extracts the rest of the line (including leading whitespace); false if nothing is left
+    bool rest(std::string& out) {
+        out.clear();
+        if (failed || cur == end) {failed = true; return false;}
+        out.assign(cur, end - cur);
+        cur = end;
+        return true;
+    }
+};
+
+#endif // End of include guard
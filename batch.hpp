@@ -0,0 +1,105 @@
+// batch.hpp
+#ifndef BATCH_HPP // Prevents multiple inclusion of this header file
+#define BATCH_HPP
+
+#include "commands.hpp"  // dispatch_command, Slice and refresh_rankings
+#include <streambuf>     // For std::streambuf
+#include <ostream>       // For std::ostream
+#include <vector>        // For std::vector
+#include <exception>     // For std::exception_ptr
+#include <cstring>       // For std::memchr and std::memmove
+#include <cerrno>        // For errno
+#include <unistd.h>      // For read and write
+
+// OutputBuffer is a streambuf that collects output in a large buffer and writes it to a
+// file descriptor only when the buffer fills up or flush() is called. sync() (what
+// std::endl and std::flush call) is a no-op, so per-command flushes cost nothing.
+// In durable mode, output is only written once the records it reports are on disk, so
+// one fsync wait covers a whole buffer. A failure while draining from overflow() would be
+// swallowed by the stream, so it is kept and thrown by flush(); nothing more is written.
+class OutputBuffer : public std::streambuf {
+private:
+    int fd;                 // Destination
+    std::vector<char> buf;  // Pending output
+    std::exception_ptr failure; // First failed drain
+
+    // Writes the pending bytes to fd
+    void drain() {
+        if (!failure) {
+            try {
+                await_durable();
+                write_all(fd, pbase(), pptr() - pbase(), "output");
+            } catch (...) {
+                failure = std::current_exception();
+            }
+        }
+        setp(buf.data(), buf.data() + buf.size());
+    }
+
+protected:
+    int_type overflow(int_type c) override {
+        drain();
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+    int sync() override {return 0;} // Deferred to flush()
+
+public:
+    explicit OutputBuffer(int out_fd, std::size_t size = 1 << 20) : fd(out_fd), buf(size) {
+        setp(buf.data(), buf.data() + buf.size());
+    }
+
+    // Writes everything collected so far; throws if this or an earlier write failed
+    void flush() {
+        if (pptr() != pbase()) drain();
+        if (failure) std::rethrow_exception(failure);
+    }
+};
+
+// Runs every command read from in_fd and writes the output to out_fd, stopping at EXIT.
+// Input is read in large blocks and split into lines in place; each line is handed to
+// dispatch_command as a slice, so no per-line string or stream is allocated. The
+// commands of each block run in a non-atomic transaction, so the rankings of the files
+// they change are refreshed once per block (or before a ranking query)
+// instead of after every INSERT and UPDATE.
+inline void run_batch(int in_fd, int out_fd, std::size_t block = 1 << 20) {
+    OutputBuffer outbuf(out_fd);
+    std::ostream out(&outbuf);
+    Session session;
+    Transaction deferred(false);
+    Transaction::Scope scope(deferred);
+    std::vector<char> in(block);
+    std::size_t have = 0;
+    bool eof = false, open = true;
+    while (open && !eof) {
+        if (have == in.size()) in.resize(in.size() * 2); // One line longer than the buffer
+        ssize_t n = ::read(in_fd, in.data() + have, in.size() - have);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw_errno("Cannot read input");
+        }
+        if (n == 0) eof = true;
+        have += n;
+
+        const char* start = in.data();
+        const char* end = in.data() + have;
+        while (open) {
+            const char* nl = static_cast<const char*>(std::memchr(start, '\n', end - start));
+            if (!nl) {
+                if (!eof || start == end) break;
+                nl = end; // Last line without a newline
+            }
+            open = dispatch_command(Slice(start, nl - start), out, session);
+            start = nl == end ? end : nl + 1;
+        }
+        refresh_rankings(deferred);
+        have = end - start;
+        std::memmove(in.data(), start, have); // Keep the partial last line
+    }
+    outbuf.flush();
+}
+
+#endif // End of include guard
@@ -0,0 +1,56 @@
+#!/bin/bash
+# recovery_bench.sh
+# Measures durable-mode recovery time against store size.
+#
+# For each store size it writes a synthetic workload through ./main --data-dir, then
+# restarts ./main on the same directory with empty input and reports the recovery time
+# printed on stderr. Each size is measured twice: with the WAL only (no checkpoints) and
+# after a CHECKPOINT followed by a WAL tail of TAIL_RECORDS records.
+#
+# Usage: bench/recovery_bench.sh [binary] [sizes...]
+#   binary  path to the built executable (default ./main)
+#   sizes   numbers of files to create (default 1000 10000 50000); each file gets
+#           VERSIONS snapshotted versions of CONTENT_BYTES appended bytes
+set -e
+
+BIN=${1:-./main}
+shift || true
+SIZES=${@:-"1000 10000 50000"}
+VERSIONS=${VERSIONS:-8}
+CONTENT_BYTES=${CONTENT_BYTES:-64}
+TAIL_RECORDS=${TAIL_RECORDS:-1000}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# Emits the workload for $1 files
+workload() {
+    awk -v files="$1" -v versions="$VERSIONS" -v bytes="$CONTENT_BYTES" 'BEGIN {
+        pad = sprintf("%" bytes "s", ""); gsub(/ /, "x", pad);
+        for (f = 0; f < files; f++) print "CREATE f" f;
+        for (v = 0; v < versions; v++)
+            for (f = 0; f < files; f++) { print "INSERT f" f " " pad; print "SNAPSHOT f" f " v" v; }
+    }'
+}
+
+# Emits $1 INSERT records spread over the first files
+tail_workload() {
+    awk -v n="$1" 'BEGIN { for (i = 0; i < n; i++) print "INSERT f" (i % 100) " tail" i; }'
+}
+
+# Prints the recovery time in ms of the store in $1
+recovery_ms() {
+    "$BIN" --data-dir "$1" < /dev/null 2>&1 >/dev/null | sed -n 's/.* in \([0-9]*\) ms.*/\1/p'
+}
+
+printf "%-10s %-12s %-12s %-14s %-14s\n" files records store_bytes wal_only_ms ckpt+tail_ms
+for n in $SIZES; do
+    dir="$WORK/store_$n"
+    workload "$n" | "$BIN" --data-dir "$dir" --checkpoint-every 0 --sync-every 4096 > /dev/null 2>&1
+    records=$(( n + 2 * n * VERSIONS ))
+    bytes=$(du -sb "$dir" | cut -f1)
+    wal_ms=$(recovery_ms "$dir")
+
+    { echo CHECKPOINT; tail_workload "$TAIL_RECORDS"; } | "$BIN" --data-dir "$dir" --checkpoint-every 0 > /dev/null 2>&1
+    ckpt_ms=$(recovery_ms "$dir")
+    printf "%-10s %-12s %-12s %-14s %-14s\n" "$n" "$records" "$bytes" "$wal_ms" "$ckpt_ms"
+done
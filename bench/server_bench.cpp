@@ -0,0 +1,158 @@
+// server_bench.cpp
+// Measures command throughput of ./main --listen against the number of client threads.
+//
+// Each client thread opens its own connection and works on its own files, so the files
+// never contend and the measurement shows how well independent commands scale across
+// the sharded file table. Every round a thread pipelines a batch of UPDATE/READ commands
+// (UPDATE_PCT percent updates) and reads back the known number of response lines.
+//
+// Build: ./build.sh bench
+// Usage: bench/server_bench <unix:path|tcp:[host:]port> [seconds] [threads...]
+//   seconds  run time per thread count (default 3)
+//   threads  client thread counts to measure (default 1 2 4 8)
+#include <iostream>      // For output
+#include <string>        // For std::string
+#include <vector>        // For std::vector
+#include <thread>        // For client threads
+#include <atomic>        // For the shared counters
+#include <chrono>        // For timing
+#include <cstring>       // For std::memset
+#include <cstdlib>       // For std::atoi and std::getenv
+#include <stdexcept>     // For exception handling
+#include <unistd.h>      // For close
+#include <netdb.h>       // For getaddrinfo
+#include <sys/socket.h>  // For socket and connect
+#include <sys/un.h>      // For sockaddr_un
+#include <netinet/in.h>  // For IPPROTO_TCP
+#include <netinet/tcp.h> // For TCP_NODELAY
+
+using namespace std;
+
+const int BATCH = 32;          // Commands pipelined per round
+const int FILES_PER_THREAD = 8; // Files each thread works on
+
+// Opens a connection to addr (same syntax as --listen)
+int connect_to(const string& addr) {
+    int fd = -1;
+    if (addr.compare(0, 5, "unix:") == 0) {
+        sockaddr_un sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sun_family = AF_UNIX;
+        strncpy(sa.sun_path, addr.c_str() + 5, sizeof(sa.sun_path) - 1);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&sa), sizeof(sa)) != 0) throw runtime_error("Cannot connect to " + addr);
+        return fd;
+    }
+    if (addr.compare(0, 4, "tcp:") != 0) throw invalid_argument("Address must be unix:<path> or tcp:[<host>:]<port>");
+    string spec = addr.substr(4), host = "127.0.0.1", port = spec;
+    size_t colon = spec.rfind(':');
+    if (colon != string::npos) {host = spec.substr(0, colon); port = spec.substr(colon + 1);}
+    addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &res) != 0) throw runtime_error("Cannot resolve " + addr);
+    fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    bool ok = fd >= 0 && connect(fd, res->ai_addr, res->ai_addrlen) == 0;
+    freeaddrinfo(res);
+    if (!ok) throw runtime_error("Cannot connect to " + addr);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+// Connection that sends command batches and waits for a known number of response lines
+struct Client {
+    int fd;
+    string inbuf;
+
+    explicit Client(const string& addr) : fd(connect_to(addr)) {}
+    ~Client() {close(fd);}
+
+    void send_all(const string& data) {
+        size_t sent = 0;
+        while (sent < data.size()) {
+            ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0) throw runtime_error("Connection lost");
+            sent += n;
+        }
+    }
+
+    void wait_lines(int lines) {
+        char buf[65536];
+        while (lines > 0) {
+            size_t nl;
+            while (lines > 0 && (nl = inbuf.find('\n')) != string::npos) {inbuf.erase(0, nl + 1); lines--;}
+            if (lines == 0) break;
+            ssize_t n = recv(fd, buf, sizeof(buf), 0);
+            if (n <= 0) throw runtime_error("Connection lost");
+            inbuf.append(buf, n);
+        }
+    }
+};
+
+// Runs one thread's workload until stop is set; counts completed commands in ops
+void client_thread(const string& addr, int id, int update_pct, atomic<bool>& stop, atomic<long>& ops) {
+    Client c(addr);
+    string setup;
+    for (int i = 0; i < FILES_PER_THREAD; i++) {
+        string f = "b" + to_string(id) + "_" + to_string(i);
+        setup += "DELETE " + f + "\nCREATE " + f + "\nINSERT " + f + " seed\n";
+    }
+    c.send_all(setup);
+    c.wait_lines(3 * FILES_PER_THREAD); // One line per command, including DELETE's "not found"
+
+    unsigned seed = id * 7919 + 1;
+    long done = 0;
+    while (!stop) {
+        string batch;
+        int lines = 0;
+        for (int i = 0; i < BATCH; i++) {
+            seed = seed * 1103515245 + 12345;
+            string f = "b" + to_string(id) + "_" + to_string((seed >> 8) % FILES_PER_THREAD);
+            if (static_cast<int>((seed >> 16) % 100) < update_pct) {
+                batch += "UPDATE " + f + " payload-" + to_string(seed % 1000) + "\n";
+                lines += 1;
+            } else {
+                batch += "READ " + f + "\n";
+                lines += 2; // Header plus single-line content
+            }
+        }
+        c.send_all(batch);
+        c.wait_lines(lines);
+        done += BATCH;
+    }
+    ops += done;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        cerr << "Usage: " << argv[0] << " <unix:path|tcp:[host:]port> [seconds] [threads...]" << endl;
+        return 1;
+    }
+    string addr = argv[1];
+    int seconds = argc > 2 ? atoi(argv[2]) : 3;
+    vector<int> counts;
+    for (int i = 3; i < argc; i++) counts.push_back(atoi(argv[i]));
+    if (counts.empty()) counts = {1, 2, 4, 8};
+    int update_pct = getenv("UPDATE_PCT") ? atoi(getenv("UPDATE_PCT")) : 50;
+
+    cout << "threads  ops/s" << endl;
+    try {
+        for (int n : counts) {
+            atomic<bool> stop(false);
+            atomic<long> ops(0);
+            vector<thread> threads;
+            auto start = chrono::steady_clock::now();
+            for (int i = 0; i < n; i++) threads.emplace_back(client_thread, addr, i, update_pct, ref(stop), ref(ops));
+            this_thread::sleep_for(chrono::seconds(seconds));
+            stop = true;
+            for (auto& t : threads) t.join();
+            double secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            cout << n << "\t " << static_cast<long>(ops / secs) << endl;
+        }
+    } catch (exception& e) {
+        cerr << "Error: " << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,380 @@
+// workload_bench.cpp
+// Generates a synthetic workload and measures it per operation, in two layers:
+//   direct    File, FileHash and RankTree called directly, with no parsing or locking
+//   dispatch  the same commands as text through dispatch_command (tokenizing, sharded
+//             table, locks, heaps and output formatting, written to a discarding stream)
+// Comparing the two separates data-structure cost from command-handling cost.
+//
+// Setup creates the files and grows each one a version tree of --depth snapshotted
+// versions, each added under the version (v - 1) / --branch, so --branch 1 gives a chain
+// and larger values bushier trees. Setup is not measured. The measured phase then runs
+// --ops operations drawn from --mix, on files chosen with Zipfian popularity (file i is
+// picked with weight 1 / (i + 1)^--zipf; 0 is uniform). The generator tracks each file's
+// versions, so ROLLBACK always names an existing version; a SNAPSHOT of a version that is
+// already snapshotted is kept and measures the rejection in both layers. A seed fixes the
+// whole workload.
+//
+// Reported for each layer and operation: count, throughput (operations per second of
+// time spent in that operation) and p50/p99/p999 latency in microseconds.
+//
+// Build: ./build.sh bench
+// Usage: bench/workload_bench [--files N] [--depth D] [--branch B] [--content BYTES]
+//            [--ops N] [--zipf S] [--mix op=weight,...] [--seed N] [--layer direct|dispatch|both] [--emit]
+//   --emit prints the whole workload as commands for ./main instead of running it
+//   ops for --mix: read insert update snapshot rollback history recent biggest churn
+//   (churn deletes a file and creates it again)
+#include "../commands.hpp" // Command dispatch and everything below it
+#include <iostream>      // For output
+#include <iomanip>       // For std::setw and std::setprecision
+#include <string>        // For std::string
+#include <vector>        // For std::vector
+#include <random>        // For std::mt19937_64
+#include <algorithm>     // For std::sort and std::upper_bound
+#include <chrono>        // For timing
+#include <cmath>         // For std::pow
+#include <cstdlib>       // For std::strtol and std::strtod
+#include <cstring>       // For std::strcmp
+#include <streambuf>     // For the discarding stream buffer
+#include <stdexcept>     // For exception handling
+
+using namespace std;
+
+// Operations of the measured phase
+enum OpKind {OP_READ, OP_INSERT, OP_UPDATE, OP_SNAPSHOT, OP_ROLLBACK, OP_HISTORY, OP_RECENT, OP_BIGGEST, OP_CHURN, OP_KINDS};
+
+const char* const OP_NAMES[OP_KINDS] = {"read", "insert", "update", "snapshot", "rollback", "history", "recent", "biggest", "churn"};
+const int TOP_K = 10; // k for RECENT_FILES and BIGGEST_TREES
+
+// Workload parameters
+struct Config {
+    int files = 1000;
+    int depth = 16;
+    int branch = 2;
+    int content = 64;
+    long ops = 200000;
+    double zipf = 0.99;
+    unsigned long seed = 1;
+    string layer = "both";
+    bool emit = false;
+    double mix[OP_KINDS] = {40, 20, 5, 15, 10, 5, 2, 2, 1};
+};
+
+// One generated operation
+struct Op {
+    OpKind kind;
+    int file;
+    int version;          // ROLLBACK target
+    size_t text_off;      // Content: a slice of the shared text
+    string line;          // The same operation as a command
+};
+
+// Discards everything written to it
+class NullBuf : public streambuf {
+protected:
+    int overflow(int c) override {return c;}
+    streamsize xsputn(const char*, streamsize n) override {return n;}
+};
+
+// Latencies of one operation kind in one layer
+struct Samples {
+    vector<double> us;
+    double total_us = 0;
+
+    void add(double t) {us.push_back(t); total_us += t;}
+};
+
+// Picks file indices with Zipfian popularity
+class Zipf {
+private:
+    vector<double> cdf;
+public:
+    Zipf(int n, double s) : cdf(n) {
+        double sum = 0;
+        for (int i = 0; i < n; i++) cdf[i] = sum += 1.0 / pow(i + 1.0, s);
+        for (double& c : cdf) c /= sum;
+    }
+    int operator()(mt19937_64& rng) const {
+        double u = uniform_real_distribution<double>(0, 1)(rng);
+        return min(static_cast<int>(upper_bound(cdf.begin(), cdf.end(), u) - cdf.begin()), static_cast<int>(cdf.size()) - 1);
+    }
+};
+
+// Generates the setup commands and the measured operations
+class Generator {
+private:
+    const Config& cfg;
+    mt19937_64 rng;
+    Zipf zipf;
+    vector<vector<bool>> snapshotted; // Per file and version, as the commands will leave them
+    vector<int> active;               // Active version per file
+
+    void create(int f) {
+        snapshotted[f].assign(1, true);
+        active[f] = 0;
+    }
+    // Applies an INSERT or UPDATE to the model
+    void edit(int f) {
+        if (!snapshotted[f][active[f]]) return;
+        active[f] = snapshotted[f].size();
+        snapshotted[f].push_back(false);
+    }
+
+public:
+    string text; // Shared source of content slices
+
+    explicit Generator(const Config& c) : cfg(c), rng(c.seed), zipf(c.files, c.zipf), snapshotted(c.files), active(c.files) {
+        text.resize(1 << 20);
+        for (char& ch : text) ch = 'a' + rng() % 26;
+    }
+
+    static string name(int f) {return "w" + to_string(f);}
+    string content(size_t off) const {return text.substr(off, cfg.content);}
+    size_t random_offset() {return rng() % (text.size() - cfg.content);}
+
+    // Returns the setup commands: create every file and grow its version tree
+    vector<string> setup() {
+        vector<string> lines;
+        for (int f = 0; f < cfg.files; f++) {
+            create(f);
+            lines.push_back("CREATE " + name(f));
+            for (int v = 1; v <= cfg.depth; v++) {
+                int parent = (v - 1) / cfg.branch;
+                if (active[f] != parent) {
+                    active[f] = parent;
+                    lines.push_back("ROLLBACK " + name(f) + " " + to_string(parent));
+                }
+                edit(f);
+                lines.push_back("INSERT " + name(f) + " " + content(random_offset()));
+                snapshotted[f][active[f]] = true;
+                lines.push_back("SNAPSHOT " + name(f) + " v" + to_string(v));
+            }
+        }
+        return lines;
+    }
+
+    // Returns the measured operations
+    vector<Op> operations() {
+        double total = 0;
+        for (double w : cfg.mix) total += w;
+        vector<Op> ops;
+        ops.reserve(cfg.ops);
+        for (long i = 0; i < cfg.ops; i++) {
+            double pick = uniform_real_distribution<double>(0, total)(rng);
+            int k = 0;
+            while (k < OP_KINDS - 1 && (pick -= cfg.mix[k]) >= 0) k++;
+            Op op{static_cast<OpKind>(k), zipf(rng), 0, 0, ""};
+            string f = name(op.file);
+            switch (op.kind) {
+                case OP_READ: op.line = "READ " + f; break;
+                case OP_INSERT:
+                case OP_UPDATE:
+                    op.text_off = random_offset();
+                    op.line = (op.kind == OP_INSERT ? "INSERT " : "UPDATE ") + f + " " + content(op.text_off);
+                    edit(op.file);
+                    break;
+                case OP_SNAPSHOT:
+                    op.line = "SNAPSHOT " + f + " s" + to_string(i);
+                    snapshotted[op.file][active[op.file]] = true;
+                    break;
+                case OP_ROLLBACK:
+                    op.version = rng() % snapshotted[op.file].size();
+                    op.line = "ROLLBACK " + f + " " + to_string(op.version);
+                    active[op.file] = op.version;
+                    break;
+                case OP_HISTORY: op.line = "HISTORY " + f; break;
+                case OP_RECENT: op.line = "RECENT_FILES " + to_string(TOP_K); break;
+                case OP_BIGGEST: op.line = "BIGGEST_TREES " + to_string(TOP_K); break;
+                default:
+                    op.line = "DELETE " + f + "\nCREATE " + f;
+                    create(op.file);
+            }
+            ops.push_back(move(op));
+        }
+        return ops;
+    }
+};
+
+// Runs the workload directly against File, FileHash and RankTree
+void run_direct(Generator& gen, const vector<string>& setup, const vector<Op>& ops, Samples* samples) {
+    FileHash table;
+    RankTree<RecentCmp> recent;
+    RankTree<BiggestCmp> biggest;
+    for (const string& line : setup) { // Replays the setup commands without parsing them
+        Args args(Slice(line.data(), line.size()));
+        string cmd, fname, arg;
+        args.word(cmd);
+        args.word(fname);
+        args.rest(arg);
+        if (!arg.empty()) arg.erase(0, 1);
+        if (cmd == "CREATE") {
+            File* f = new File(fname);
+            table.put(f);
+            recent.insert(f);
+            biggest.insert(f);
+            continue;
+        }
+        File* f = table.get(fname);
+        if (cmd == "ROLLBACK") f->Rollback(stoi(arg));
+        else if (cmd == "INSERT") {f->Insert(arg); recent.update(f); biggest.update(f);}
+        else f->Snapshot(arg);
+    }
+
+    volatile size_t sink = 0; // Stores to it keep results from being optimized away
+    for (const Op& op : ops) {
+        string fname = Generator::name(op.file);
+        string text = op.kind == OP_INSERT || op.kind == OP_UPDATE ? gen.content(op.text_off) : string();
+        auto start = chrono::steady_clock::now();
+        File* f = table.get(fname);
+        switch (op.kind) {
+            case OP_READ: sink += f->Read().size(); break;
+            case OP_INSERT: f->Insert(text); recent.update(f); biggest.update(f); break;
+            case OP_UPDATE: f->Update(text); recent.update(f); biggest.update(f); break;
+            case OP_SNAPSHOT:
+                if (!f->get_active_version()->is_snapshot()) f->Snapshot("s");
+                break;
+            case OP_ROLLBACK: f->Rollback(op.version); break;
+            case OP_HISTORY: sink += f->History().size(); break;
+            case OP_RECENT: sink += recent.top_k(TOP_K).size(); break;
+            case OP_BIGGEST: sink += biggest.top_k(TOP_K).size(); break;
+            default:
+                recent.remove(f);
+                biggest.remove(f);
+                delete table.remove(fname);
+                f = new File(fname);
+                table.put(f);
+                recent.insert(f);
+                biggest.insert(f);
+        }
+        samples[op.kind].add(chrono::duration<double, micro>(chrono::steady_clock::now() - start).count());
+    }
+    vector<File*> all;
+    table.for_each([&](File* f) {all.push_back(f);});
+    for (File* f : all) delete f;
+}
+
+// Runs the workload as command lines through dispatch_command
+void run_dispatch(const vector<string>& setup, const vector<Op>& ops, Samples* samples) {
+    NullBuf buf;
+    ostream out(&buf);
+    Session session;
+    use_color = false;
+    for (const string& line : setup) dispatch_command(Slice(line.data(), line.size()), out, session);
+    for (const Op& op : ops) {
+        auto start = chrono::steady_clock::now();
+        if (op.kind != OP_CHURN) dispatch_command(Slice(op.line.data(), op.line.size()), out, session);
+        else {
+            size_t nl = op.line.find('\n');
+            dispatch_command(Slice(op.line.data(), nl), out, session);
+            dispatch_command(Slice(op.line.data() + nl + 1, op.line.size() - nl - 1), out, session);
+        }
+        samples[op.kind].add(chrono::duration<double, micro>(chrono::steady_clock::now() - start).count());
+    }
+}
+
+// Prints one layer's results
+void report(const string& layer, Samples* samples, double wall_s, long ops) {
+    cout << layer << ": " << ops << " ops in " << fixed << setprecision(3) << wall_s << " s ("
+         << static_cast<long>(ops / wall_s) << " ops/s including timing overhead)" << endl;
+    cout << "  " << left << setw(10) << "op" << right << setw(10) << "count" << setw(12) << "ops/s"
+         << setw(11) << "p50 us" << setw(11) << "p99 us" << setw(11) << "p999 us" << endl;
+    for (int k = 0; k < OP_KINDS; k++) {
+        vector<double>& us = samples[k].us;
+        if (us.empty()) continue;
+        sort(us.begin(), us.end());
+        auto pct = [&](double p) {return us[min(us.size() - 1, static_cast<size_t>(p * us.size()))];};
+        cout << "  " << left << setw(10) << OP_NAMES[k] << right << setw(10) << us.size()
+             << setw(12) << static_cast<long>(us.size() / (samples[k].total_us / 1e6))
+             << setprecision(2) << setw(11) << pct(0.50) << setw(11) << pct(0.99) << setw(11) << pct(0.999) << endl;
+    }
+}
+
+// Parses op=weight,... into cfg.mix; ops not named get weight 0
+bool parse_mix(const string& spec, Config& cfg) {
+    for (double& w : cfg.mix) w = 0;
+    size_t pos = 0;
+    while (pos < spec.size()) {
+        size_t comma = spec.find(',', pos);
+        if (comma == string::npos) comma = spec.size();
+        string item = spec.substr(pos, comma - pos);
+        size_t eq = item.find('=');
+        if (eq == string::npos) return false;
+        int k = 0;
+        while (k < OP_KINDS && item.compare(0, eq, OP_NAMES[k]) != 0) k++;
+        char* end;
+        double w = strtod(item.c_str() + eq + 1, &end);
+        if (k == OP_KINDS || *end || w < 0) return false;
+        cfg.mix[k] = w;
+        pos = comma + 1;
+    }
+    double total = 0;
+    for (double w : cfg.mix) total += w;
+    return total > 0;
+}
+
+// Parses the command line; returns false on invalid input
+bool parse_options(int argc, char** argv, Config& cfg) {
+    for (int i = 1; i < argc; i++) {
+        const char* opt = argv[i];
+        if (strcmp(opt, "--emit") == 0) {cfg.emit = true; continue;}
+        if (i + 1 >= argc) return false;
+        const char* val = argv[++i];
+        char* end;
+        long n = strtol(val, &end, 10);
+        bool count = *val && !*end && n > 0;
+        if (strcmp(opt, "--files") == 0 && count) cfg.files = n;
+        else if (strcmp(opt, "--depth") == 0 && *val && !*end && n >= 0) cfg.depth = n;
+        else if (strcmp(opt, "--branch") == 0 && count) cfg.branch = n;
+        else if (strcmp(opt, "--content") == 0 && count && n < (1 << 19)) cfg.content = n;
+        else if (strcmp(opt, "--ops") == 0 && count) cfg.ops = n;
+        else if (strcmp(opt, "--seed") == 0 && *val && !*end && n >= 0) cfg.seed = n;
+        else if (strcmp(opt, "--zipf") == 0) {
+            cfg.zipf = strtod(val, &end);
+            if (!*val || *end || cfg.zipf < 0) return false;
+        }
+        else if (strcmp(opt, "--mix") == 0) {if (!parse_mix(val, cfg)) return false;}
+        else if (strcmp(opt, "--layer") == 0 && (!strcmp(val, "direct") || !strcmp(val, "dispatch") || !strcmp(val, "both"))) cfg.layer = val;
+        else return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    Config cfg;
+    if (!parse_options(argc, argv, cfg)) {
+        cerr << "Usage: " << argv[0] << " [--files N] [--depth D] [--branch B] [--content BYTES] [--ops N] [--zipf S]"
+             << " [--mix op=weight,...] [--seed N] [--layer direct|dispatch|both] [--emit]" << endl;
+        return 1;
+    }
+    ios::sync_with_stdio(false);
+    Generator gen(cfg);
+    vector<string> setup = gen.setup();
+    vector<Op> ops = gen.operations();
+    if (cfg.emit) {
+        for (const string& line : setup) cout << line << '\n';
+        for (const Op& op : ops) cout << op.line << '\n';
+        return 0;
+    }
+
+    cout << "files=" << cfg.files << " depth=" << cfg.depth << " branch=" << cfg.branch << " content=" << cfg.content
+         << " ops=" << cfg.ops << " zipf=" << cfg.zipf << " seed=" << cfg.seed << " mix=";
+    for (int k = 0; k < OP_KINDS; k++) cout << (k ? "," : "") << OP_NAMES[k] << "=" << cfg.mix[k];
+    cout << endl;
+    try {
+        if (cfg.layer != "dispatch") {
+            Samples samples[OP_KINDS];
+            auto start = chrono::steady_clock::now();
+            run_direct(gen, setup, ops, samples);
+            report("direct", samples, chrono::duration<double>(chrono::steady_clock::now() - start).count(), cfg.ops);
+        }
+        if (cfg.layer != "direct") {
+            Samples samples[OP_KINDS];
+            auto start = chrono::steady_clock::now();
+            run_dispatch(setup, ops, samples);
+            report("dispatch", samples, chrono::duration<double>(chrono::steady_clock::now() - start).count(), cfg.ops);
+        }
+    } catch (exception& e) {
+        cerr << "Error: " << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -1,6 +1,11 @@
 #!/bin/bash
 set -e
 
-g++ -std=c++11 -O2 main.cpp -o main
+g++ -std=c++11 -O2 -pthread main.cpp -o main
+
+if [ "$1" == "bench" ]; then
+    g++ -std=c++11 -O2 -pthread bench/server_bench.cpp -o bench/server_bench
+    g++ -std=c++11 -O2 -pthread bench/workload_bench.cpp -o bench/workload_bench
+fi
 
 echo "Build complete. Run with ./main"
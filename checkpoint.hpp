@@ -0,0 +1,435 @@
+// checkpoint.hpp
+#ifndef CHECKPOINT_HPP // Prevents multiple inclusion of this header file
+#define CHECKPOINT_HPP
+
+#include "file.hpp"        // Includes File and TreeNode definitions
+#include <string>          // For std::string
+#include <vector>          // For std::vector
+#include <unordered_map>   // For the blob table
+#include <memory>          // For std::shared_ptr and std::unique_ptr
+#include <array>           // For the CRC table
+#include <cstdint>         // For fixed-width integers
+#include <cstring>         // For std::memcpy and std::strerror
+#include <cerrno>          // For errno
+#include <stdexcept>       // For exception handling
+#include <fcntl.h>         // For open
+#include <unistd.h>        // For write, fsync and close
+#include <sys/stat.h>      // For fstat
+#include <sys/mman.h>      // For mmap, madvise and munmap
+
+// ---------------- IO HELPERS ----------------
+
+// Builds the lookup table for crc32
+inline std::array<std::uint32_t, 256> make_crc32_table() {
+    std::array<std::uint32_t, 256> table;
+    for (std::uint32_t i = 0; i < 256; i++) {
+        std::uint32_t c = i;
+        for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        table[i] = c;
+    }
+    return table;
+}
+
+// Computes the CRC-32 (IEEE) of a byte range
+inline std::uint32_t crc32(const char* data, std::size_t n, std::uint32_t crc = 0) {
+    static const std::array<std::uint32_t, 256> table = make_crc32_table();
+    crc = ~crc;
+    for (std::size_t i = 0; i < n; i++) {
+        crc = table[(crc ^ static_cast<unsigned char>(data[i])) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+// Throws a runtime_error describing the last system call failure
+inline void throw_errno(const std::string& what) {
+    throw std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+// Writes all bytes to fd, retrying on short writes
+inline void write_all(int fd, const char* data, std::size_t n, const std::string& what) {
+    while (n > 0) {
+        ssize_t w = ::write(fd, data, n);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            throw_errno("Cannot write " + what);
+        }
+        data += w;
+        n -= w;
+    }
+}
+
+// ---------------- ON-DISK LAYOUT ----------------
+//
+// A checkpoint is designed to be mmap'ed and used in place:
+//
+//   CkptHeader
+//   CkptFile[file_count]      one per file; its nodes are a contiguous run of the node table
+//   CkptNode[node_count]      version nodes in version-ID order, parents as file-relative indices
+//   CkptPiece[piece_count]    content pieces of the nodes, as ranges of the blob area
+//   CkptEvent[event_count]    changes of active version, grouped by file in file order
+//   CkptMerge[merge_count]    second parents of merge versions, in node order
+//   string pool               file names and snapshot messages
+//   padding to a page boundary
+//   blob area                 raw content bytes; a blob shared by several versions is stored once
+//
+// Loading only walks the metadata (verified by meta_crc); content pieces become views
+// into the mapping, so the blob pages that end up resident are the ones READ touches.
+// Integers are in host byte order. Checkpoints written before merges existed ("TTFSCKP2")
+// have a header without merge_count and no merge records; they are still read.
+
+struct CkptHeader {
+    char magic[8];             // "TTFSCKP3"
+    std::uint64_t lsn;         // Last WAL record included
+    std::uint64_t file_count;
+    std::uint64_t node_count;
+    std::uint64_t piece_count;
+    std::uint64_t pool_bytes;
+    std::uint64_t blob_offset; // Page-aligned file offset of the blob area
+    std::uint64_t blob_bytes;
+    std::uint32_t meta_crc;    // CRC-32 of the bytes between the header and the blob area
+    std::uint32_t event_count; // 0 in checkpoints written before timelines were saved
+    std::uint64_t merge_count; // Not in "TTFSCKP2" headers
+};
+
+struct CkptFile {
+    std::uint64_t name_off;    // File name in the string pool
+    std::uint32_t name_len;
+    std::int32_t total_versions;
+    std::int64_t last_modified;
+    std::uint64_t first_node;  // Index of the file's first (root) node
+    std::uint32_t node_count;
+    std::int32_t active_node;  // File-relative index of the active version
+};
+
+struct CkptNode {
+    std::int32_t version_id;
+    std::int32_t parent;       // File-relative index of the parent, -1 for the root
+    std::int64_t created;
+    std::int64_t snapshot_ts;  // 0 if not snapshotted
+    std::uint64_t msg_off;     // Snapshot message in the string pool
+    std::uint32_t msg_len;
+    std::uint32_t piece_count;
+    std::uint64_t first_piece;
+};
+
+struct CkptPiece {
+    std::uint64_t blob_off;    // Offset within the blob area
+    std::uint64_t len;
+};
+
+struct CkptEvent {
+    std::int64_t at;
+    std::uint32_t file;        // Index of the file record
+    std::int32_t version;      // ID of the version made active (it may have been reclaimed since)
+};
+
+struct CkptMerge {
+    std::uint64_t node;        // Index of the merge version in the node table
+    std::int32_t merge_parent; // File-relative index of its second parent
+    std::uint32_t reserved;    // 0
+};
+
+static_assert(sizeof(CkptHeader) == 80 && sizeof(CkptFile) == 40 && sizeof(CkptNode) == 48 && sizeof(CkptPiece) == 16
+              && sizeof(CkptEvent) == 16 && sizeof(CkptMerge) == 16,
+              "Checkpoint records must have a fixed layout");
+
+// ---------------- READER / WRITER ----------------
+
+// CheckpointIO builds and loads checkpoints of whole files, version trees included
+class CheckpointIO {
+private:
+    static constexpr const char* MAGIC = "TTFSCKP3";
+    static constexpr const char* MAGIC_V2 = "TTFSCKP2";    // Written before merges existed
+    static constexpr std::size_t HEADER_V2 = 72;            // ... with a header ending at event_count
+    static constexpr std::size_t PAGE = 4096;
+
+    // Source range of one blob in memory
+    struct Blob {
+        const char* data;
+        std::size_t len;
+        std::uint64_t blob_off;
+    };
+
+    std::vector<CkptFile> files;
+    std::vector<CkptNode> nodes;
+    std::vector<CkptPiece> pieces;
+    std::vector<CkptEvent> events;
+    std::vector<CkptMerge> merges;
+    std::vector<std::size_t> piece_blob;   // Blob index of each piece (offsets assigned in write)
+    std::string pool;
+    std::vector<Blob> blobs;
+    std::unordered_map<const char*, std::size_t> blob_ids; // Blob start -> index; pieces sharing a start share a blob
+    std::vector<Rope> expanded;            // Decompressed contents of packed versions
+    std::vector<std::unique_ptr<File>> reloaded; // Version trees read back from spill files
+
+    // Adds a string to the pool and returns its offset
+    std::uint64_t add_string(const std::string& s) {
+        std::uint64_t off = pool.size();
+        pool += s;
+        return off;
+    }
+
+    // Records the pieces of a rope, sharing blobs by start address: versions that extended
+    // the same chunk in place start at the same byte, and the longest of them is stored
+    void add_rope(const Rope& r, CkptNode& node) {
+        node.first_piece = pieces.size();
+        node.piece_count = 0;
+        r.for_each_piece([&](const Rope::Piece& p) {
+            auto it = blob_ids.find(p.data());
+            if (it == blob_ids.end()) {
+                it = blob_ids.emplace(p.data(), blobs.size()).first;
+                blobs.push_back(Blob{p.data(), p.len, 0});
+            }
+            else if (blobs[it -> second].len < p.len) {
+                blobs[it -> second].len = p.len;
+            }
+            pieces.push_back(CkptPiece{0, p.len});
+            piece_blob.push_back(it -> second);
+            node.piece_count++;
+        });
+    }
+
+    // Unmaps a mapping once the last view into it is gone
+    struct Unmapper {
+        std::size_t len;
+        void operator()(const void* p) const {::munmap(const_cast<void*>(p), len);}
+    };
+
+public:
+    // Adds one file and its whole version tree to the checkpoint being built. A spilled
+    // tree is read back for the checkpoint only; the file stays spilled.
+    void add_file(const File& f) {
+        if (f.Is_Spilled()) {
+            std::uint64_t lsn;
+            std::size_t n = reloaded.size();
+            if (!load(f.spill_path, lsn, [&](File* g) {reloaded.emplace_back(g);}, true)
+                || reloaded.size() != n + 1 || reloaded.back() -> file_name != f.file_name) {
+                throw std::runtime_error("Cannot read back spilled file '" + f.file_name + "'");
+            }
+            add_file(*reloaded.back());
+            return;
+        }
+        CkptFile cf;
+        cf.name_off = add_string(f.file_name);
+        cf.name_len = f.file_name.size();
+        cf.total_versions = f.total_versions;
+        cf.last_modified = f.last_modified;
+        cf.first_node = nodes.size();
+        cf.node_count = 0;
+        cf.active_node = -1;
+        std::vector<std::int32_t> index(f.total_versions, -1); // Version ID -> file-relative node index
+        for (int id = 0; id < f.total_versions; id++) {
+            const TreeNode* node = f.version_map.get(id);
+            if (!node) continue;
+            index[id] = cf.node_count++;
+            CkptNode cn;
+            cn.version_id = id;
+            cn.parent = node -> parent ? index[node -> parent -> get_version_id()] : -1; // Parents have smaller IDs
+            cn.created = node -> created_timestamp;
+            cn.snapshot_ts = node -> snapshot_timestamp;
+            cn.msg_off = add_string(node -> message);
+            cn.msg_len = node -> message.size();
+            if (node -> merge_parent) { // Second parents have smaller IDs too
+                merges.push_back(CkptMerge{nodes.size(), index[node -> merge_parent -> get_version_id()], 0});
+            }
+            if (node -> packed) { // Written decompressed; kept alive until write()
+                expanded.push_back(node -> packed -> unpack());
+                add_rope(expanded.back(), cn);
+            }
+            else add_rope(node -> content, cn);
+            nodes.push_back(cn);
+            if (node == f.active_version) cf.active_node = index[id];
+        }
+        for (const Activation& a : f.timeline) {
+            events.push_back(CkptEvent{a.at, static_cast<std::uint32_t>(files.size()), a.version});
+        }
+        files.push_back(cf);
+    }
+
+    // Writes the checkpoint built so far to path and, unless sync is false, fsyncs it
+    void write(const std::string& path, std::uint64_t lsn, bool sync = true) {
+        std::uint64_t blob_bytes = 0;
+        for (Blob& b : blobs) {
+            b.blob_off = blob_bytes;
+            blob_bytes += b.len;
+        }
+        for (std::size_t i = 0; i < pieces.size(); i++) pieces[i].blob_off = blobs[piece_blob[i]].blob_off;
+
+        std::string meta;
+        meta.append(reinterpret_cast<const char*>(files.data()), files.size() * sizeof(CkptFile));
+        meta.append(reinterpret_cast<const char*>(nodes.data()), nodes.size() * sizeof(CkptNode));
+        meta.append(reinterpret_cast<const char*>(pieces.data()), pieces.size() * sizeof(CkptPiece));
+        meta.append(reinterpret_cast<const char*>(events.data()), events.size() * sizeof(CkptEvent));
+        meta.append(reinterpret_cast<const char*>(merges.data()), merges.size() * sizeof(CkptMerge));
+        meta += pool;
+        std::size_t blob_offset = (sizeof(CkptHeader) + meta.size() + PAGE - 1) / PAGE * PAGE;
+        meta.resize(blob_offset - sizeof(CkptHeader), '\0');
+
+        CkptHeader h;
+        std::memcpy(h.magic, MAGIC, sizeof(h.magic));
+        h.lsn = lsn;
+        h.file_count = files.size();
+        h.node_count = nodes.size();
+        h.piece_count = pieces.size();
+        h.pool_bytes = pool.size();
+        h.blob_offset = blob_offset;
+        h.blob_bytes = blob_bytes;
+        h.meta_crc = crc32(meta.data(), meta.size());
+        h.event_count = events.size();
+        h.merge_count = merges.size();
+
+        int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) throw_errno("Cannot open " + path);
+        try {
+            write_all(fd, reinterpret_cast<const char*>(&h), sizeof(h), path);
+            write_all(fd, meta.data(), meta.size(), path);
+            std::string buf; // Batches small blobs into large writes
+            for (const Blob& b : blobs) {
+                if (buf.size() + b.len > (1 << 20)) {
+                    write_all(fd, buf.data(), buf.size(), path);
+                    buf.clear();
+                }
+                if (b.len >= (1 << 20)) write_all(fd, b.data, b.len, path);
+                else buf.append(b.data, b.len);
+            }
+            write_all(fd, buf.data(), buf.size(), path);
+            if (sync && ::fsync(fd) != 0) throw_errno("Cannot sync " + path);
+        } catch (...) {
+            ::close(fd);
+            throw;
+        }
+        ::close(fd);
+    }
+
+    // Maps the checkpoint at path and calls on_file for every restored File* (the callee
+    // takes ownership). Version contents stay in the mapping until they are modified.
+    // Detached files only carry their version tree (see File::Unspill): they take no handle
+    // and are not indexed. Returns false if there is no checkpoint; otherwise stores its
+    // LSN in lsn.
+    template <typename OnFile>
+    static bool load(const std::string& path, std::uint64_t& lsn, OnFile on_file, bool detached = false) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            if (errno == ENOENT) return false;
+            throw_errno("Cannot open " + path);
+        }
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {::close(fd); throw_errno("Cannot stat " + path);}
+        std::size_t size = st.st_size;
+        if (size < HEADER_V2) {::close(fd); throw std::runtime_error("Corrupt checkpoint: truncated header");}
+        void* addr = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd); // The mapping stays valid after closing
+        if (addr == MAP_FAILED) throw_errno("Cannot map " + path);
+        std::shared_ptr<const void> mapping(addr, Unmapper{size});
+        const char* base = static_cast<const char*>(addr);
+
+        CkptHeader h = CkptHeader();
+        std::size_t header_bytes = sizeof(CkptHeader);
+        if (std::memcmp(base, MAGIC_V2, sizeof(h.magic)) == 0) header_bytes = HEADER_V2; // merge_count stays 0
+        else if (std::memcmp(base, MAGIC, sizeof(h.magic)) != 0 || size < header_bytes) throw std::runtime_error("Corrupt checkpoint: bad header");
+        std::memcpy(&h, base, header_bytes);
+        std::uint64_t meta_bytes = h.file_count * sizeof(CkptFile) + h.node_count * sizeof(CkptNode)
+                                 + h.piece_count * sizeof(CkptPiece) + h.event_count * sizeof(CkptEvent)
+                                 + h.merge_count * sizeof(CkptMerge) + h.pool_bytes;
+        if (h.blob_offset < header_bytes + meta_bytes || h.blob_offset > size || size - h.blob_offset < h.blob_bytes) {
+            throw std::runtime_error("Corrupt checkpoint: bad section sizes");
+        }
+        if (crc32(base + header_bytes, h.blob_offset - header_bytes) != h.meta_crc) {
+            throw std::runtime_error("Corrupt checkpoint: checksum mismatch");
+        }
+        ::madvise(const_cast<char*>(base + h.blob_offset), h.blob_bytes, MADV_RANDOM); // Fault in only what READ touches
+
+        const CkptFile* cfiles = reinterpret_cast<const CkptFile*>(base + header_bytes);
+        const CkptNode* cnodes = reinterpret_cast<const CkptNode*>(cfiles + h.file_count);
+        const CkptPiece* cpieces = reinterpret_cast<const CkptPiece*>(cnodes + h.node_count);
+        const CkptEvent* cevents = reinterpret_cast<const CkptEvent*>(cpieces + h.piece_count);
+        const CkptMerge* cmerges = reinterpret_cast<const CkptMerge*>(cevents + h.event_count);
+        const char* cpool = reinterpret_cast<const char*>(cmerges + h.merge_count);
+        Rope::ChunkPtr blob_area = Chunk::make_view(base + h.blob_offset, h.blob_bytes, mapping);
+
+        auto pool_str = [&](std::uint64_t off, std::uint32_t len) {
+            if (off > h.pool_bytes || h.pool_bytes - off < len) throw std::runtime_error("Corrupt checkpoint: bad string");
+            return std::string(cpool + off, len);
+        };
+
+        std::uint64_t next_event = 0, next_merge = 0;
+        for (std::uint64_t i = 0; i < h.file_count; i++) {
+            const CkptFile& cf = cfiles[i];
+            if (cf.first_node > h.node_count || h.node_count - cf.first_node < cf.node_count || cf.node_count == 0 ||
+                cf.active_node < 0 || cf.active_node >= static_cast<std::int32_t>(cf.node_count)) {
+                throw std::runtime_error("Corrupt checkpoint: bad file record");
+            }
+            File* f = detached ? new File(pool_str(cf.name_off, cf.name_len), File::Detached())
+                               : new File(pool_str(cf.name_off, cf.name_len));
+            try {
+                std::vector<TreeNode*> by_index(cf.node_count, nullptr);
+                for (std::uint32_t k = 0; k < cf.node_count; k++) {
+                    const CkptNode& cn = cnodes[cf.first_node + k];
+                    if (cn.first_piece > h.piece_count || h.piece_count - cn.first_piece < cn.piece_count) {
+                        throw std::runtime_error("Corrupt checkpoint: bad piece range");
+                    }
+                    std::vector<Rope::Piece> parts;
+                    parts.reserve(cn.piece_count);
+                    for (std::uint32_t j = 0; j < cn.piece_count; j++) {
+                        const CkptPiece& cp = cpieces[cn.first_piece + j];
+                        if (cp.blob_off > h.blob_bytes || h.blob_bytes - cp.blob_off < cp.len) {
+                            throw std::runtime_error("Corrupt checkpoint: bad blob range");
+                        }
+                        parts.push_back(Rope::Piece{blob_area, static_cast<std::size_t>(cp.blob_off), static_cast<std::size_t>(cp.len)});
+                    }
+                    Rope content = Rope::from_pieces(std::move(parts));
+                    TreeNode* node;
+                    if (k == 0) {
+                        node = f -> root; // The File constructor already made the root
+                        node -> content = std::move(content);
+                    }
+                    else {
+                        if (cn.parent < 0 || cn.parent >= static_cast<std::int32_t>(k) || cn.version_id <= 0 || cn.version_id >= cf.total_versions) {
+                            throw std::runtime_error("Corrupt checkpoint: bad parent");
+                        }
+                        node = f -> nodes.create(cn.version_id, std::move(content), by_index[cn.parent]);
+                        f -> version_map.put(cn.version_id, node);
+                    }
+                    if (next_merge < h.merge_count && cmerges[next_merge].node == cf.first_node + k) {
+                        const CkptMerge& cm = cmerges[next_merge++];
+                        if (k == 0 || cm.merge_parent < 0 || cm.merge_parent >= static_cast<std::int32_t>(k) || cm.merge_parent == cn.parent) {
+                            throw std::runtime_error("Corrupt checkpoint: bad merge parent");
+                        }
+                        node -> set_merge_parent(by_index[cm.merge_parent]); // Before any child is created
+                    }
+                    node -> created_timestamp = Clock::from_disk(cn.created);
+                    node -> snapshot_timestamp = Clock::from_disk(cn.snapshot_ts);
+                    Clock::observe(node -> created_timestamp);
+                    Clock::observe(node -> snapshot_timestamp);
+                    node -> message = pool_str(cn.msg_off, cn.msg_len);
+                    by_index[k] = node;
+                }
+                f -> total_versions = cf.total_versions;
+                f -> last_modified = Clock::from_disk(cf.last_modified);
+                Clock::observe(f -> last_modified);
+                f -> active_version = by_index[cf.active_node];
+                f -> timeline.clear();
+                for (; next_event < h.event_count && cevents[next_event].file == i; next_event++) {
+                    const CkptEvent& ce = cevents[next_event];
+                    if (ce.version < 0 || ce.version >= cf.total_versions
+                        || (!f -> timeline.empty() && Clock::from_disk(ce.at) < f -> timeline.back().at)) {
+                        throw std::runtime_error("Corrupt checkpoint: bad timeline");
+                    }
+                    f -> timeline.push_back(Activation{Clock::from_disk(ce.at), ce.version});
+                    Clock::observe(f -> timeline.back().at);
+                }
+                if (f -> timeline.empty()) f -> rebuild_timeline(); // Written before timelines were saved
+                else if (f -> timeline.back().version != f -> active_version -> get_version_id()) throw std::runtime_error("Corrupt checkpoint: bad timeline");
+            } catch (...) {
+                delete f;
+                throw;
+            }
+            on_file(f);
+        }
+        if (next_merge != h.merge_count) throw std::runtime_error("Corrupt checkpoint: bad merge record");
+        lsn = h.lsn;
+        return true;
+    }
+};
+
+#endif // End of include guard
@@ -0,0 +1,126 @@
+// clock.hpp
+#ifndef CLOCK_HPP // Prevents multiple inclusion of this header file
+#define CLOCK_HPP
+
+#include <atomic>      // For the last issued timestamp
+#include <chrono>      // For std::chrono::system_clock
+#include <cstdint>     // For std::int64_t
+#include <ostream>     // For std::ostream
+#include <iomanip>     // For std::setw and std::setfill
+#include <string>      // For std::string
+
+// Clock class is the single source of timestamps for versions and files.
+// Timestamps are microseconds since the Unix epoch. Every timestamp handed out is strictly
+// greater than all earlier ones (across threads), so modification times never tie and never
+// go backwards even if the wall clock does; under very high command rates they may run
+// slightly ahead of the wall clock until it catches up.
+// A timestamp can be pinned for the current thread, so that every timestamp taken while
+// handling one command is identical (one clock read per command) and WAL replay
+// reproduces logged times.
+class Clock {
+public:
+    typedef std::int64_t time_point; // Microseconds since the Unix epoch
+
+    static constexpr time_point MICROS_PER_SECOND = 1000000;
+
+private:
+    // Returns the pinned timestamp of the calling thread (0 if none)
+    static time_point& pinned() {
+        static thread_local time_point t = 0;
+        return t;
+    }
+
+    // Returns the largest timestamp issued or observed so far
+    static std::atomic<time_point>& last() {
+        static std::atomic<time_point> t(0);
+        return t;
+    }
+
+    // Returns the wall clock in microseconds
+    static time_point wall() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+public:
+    // Returns the pinned timestamp if set, otherwise a new unique timestamp
+    static time_point now() {
+        time_point p = pinned();
+        return p ? p : tick();
+    }
+
+    // Returns a new timestamp: the wall clock, or one past the last timestamp if that is later
+    static time_point tick() {
+        time_point w = wall();
+        time_point prev = last().load(std::memory_order_relaxed);
+        time_point next;
+        do {
+            next = w > prev ? w : prev + 1;
+        } while (!last().compare_exchange_weak(prev, next, std::memory_order_relaxed));
+        return next;
+    }
+
+    // Records a timestamp restored from disk so that later ones are issued after it
+    static void observe(time_point t) {
+        time_point prev = last().load(std::memory_order_relaxed);
+        while (prev < t && !last().compare_exchange_weak(prev, t, std::memory_order_relaxed)) {}
+    }
+
+    // Converts a timestamp read from disk to microseconds. Data written before timestamps
+    // had sub-second resolution holds whole seconds, which are far below any microsecond
+    // value since 1970-01-02 and are scaled up.
+    static time_point from_disk(std::int64_t t) {
+        return (t > 0 && t < 100000000000LL) ? t * MICROS_PER_SECOND : t;
+    }
+
+    // Writes a timestamp as seconds since the epoch: with a six-digit fraction, or truncated
+    // to whole seconds if whole_seconds is set
+    static void write(std::ostream& os, time_point t, bool whole_seconds) {
+        os << t / MICROS_PER_SECOND;
+        if (!whole_seconds) {
+            char fill = os.fill('0');
+            os << '.' << std::setw(6) << t % MICROS_PER_SECOND;
+            os.fill(fill);
+        }
+    }
+
+    // Parses a timestamp written as seconds since the epoch, with an optional fraction of
+    // up to six digits. The text names a span as wide as its last digit (a whole second for
+    // "1700000000", a tenth for "1700000000.5"); lo and hi are set to its bounds.
+    // Returns false if s is not such a timestamp.
+    static bool parse(const std::string& s, time_point& lo, time_point& hi) {
+        std::size_t i = 0, n = s.size();
+        time_point secs = 0, frac = 0, span = MICROS_PER_SECOND;
+        if (i == n || s[i] < '0' || s[i] > '9') return false;
+        for (; i < n && s[i] >= '0' && s[i] <= '9'; i++) {
+            if (secs > (INT64_MAX / MICROS_PER_SECOND - 9) / 10) return false; // Would overflow in microseconds
+            secs = secs * 10 + (s[i] - '0');
+        }
+        if (i < n && s[i] == '.') {
+            i++;
+            if (i == n) return false;
+            for (; i < n && s[i] >= '0' && s[i] <= '9'; i++) {
+                if (span == 1) return false; // More than six fraction digits
+                span /= 10;
+                frac += (s[i] - '0') * span;
+            }
+        }
+        if (i != n) return false;
+        lo = secs * MICROS_PER_SECOND + frac;
+        hi = lo + span - 1;
+        return true;
+    }
+
+    // Pin pins the clock of the current thread to a timestamp for its lifetime
+    class Pin {
+    private:
+        time_point saved; // Previously pinned timestamp, restored on destruction
+    public:
+        explicit Pin(time_point t) : saved(pinned()) {pinned() = t;}
+        ~Pin() {pinned() = saved;}
+        Pin(const Pin&) = delete;
+        Pin& operator=(const Pin&) = delete;
+    };
+};
+
+#endif // End of include guard
@@ -0,0 +1,115 @@
+// codec.hpp
+#ifndef CODEC_HPP // Prevents multiple inclusion of this header file
+#define CODEC_HPP
+
+#include <string>      // For std::string
+#include <vector>      // For std::vector
+#include <cstdint>     // For fixed-width integers
+#include <cstring>     // For std::memcpy
+#include <cstddef>     // For std::size_t
+#include <stdexcept>   // For exception handling
+
+// A small LZ77 block codec in the style of LZ4: greedy matching through a hash table of
+// 4-byte sequences, byte-aligned output and no entropy coding, so both directions run at
+// memory speed. A block is a list of sequences, each
+//   [token][extra literal length...][literals][offset u16][extra match length...]
+// where the token's high nibble is the literal count and its low nibble the match length
+// minus 4 (15 in either means more length bytes follow, each adding up to 255). The last
+// sequence ends after its literals.
+namespace codec {
+
+static constexpr std::size_t MIN_MATCH = 4;        // Shortest match worth encoding
+static constexpr std::size_t MAX_OFFSET = 65535;   // Farthest match distance
+static constexpr int HASH_BITS = 13;               // Match table has 2^HASH_BITS entries
+
+inline std::uint32_t load32(const char* p) {
+    std::uint32_t v;
+    std::memcpy(&v, p, 4);
+    return v;
+}
+
+// Appends a length that did not fit in its token nibble
+inline void put_length(std::string& out, std::size_t n) {
+    for (; n >= 255; n -= 255) out.push_back(static_cast<char>(255));
+    out.push_back(static_cast<char>(n));
+}
+
+// Appends one sequence: literals [lit, lit + lit_len), then a match unless match_len is 0
+inline void put_sequence(std::string& out, const char* lit, std::size_t lit_len, std::size_t offset, std::size_t match_len) {
+    std::size_t ml = match_len ? match_len - MIN_MATCH : 0;
+    out.push_back(static_cast<char>(((lit_len < 15 ? lit_len : 15) << 4) | (ml < 15 ? ml : 15)));
+    if (lit_len >= 15) put_length(out, lit_len - 15);
+    out.append(lit, lit_len);
+    if (!match_len) return;
+    out.push_back(static_cast<char>(offset & 0xff));
+    out.push_back(static_cast<char>(offset >> 8));
+    if (ml >= 15) put_length(out, ml - 15);
+}
+
+// Compresses n bytes at src into out (replacing its contents)
+inline void compress(const char* src, std::size_t n, std::string& out) {
+    out.clear();
+    out.reserve(n / 2 + 16);
+    std::vector<std::int64_t> table(std::size_t(1) << HASH_BITS, -1); // Hash -> last position
+    std::size_t anchor = 0, i = 0;
+    unsigned misses = 0;
+    while (i + MIN_MATCH <= n) {
+        std::uint32_t seq = load32(src + i);
+        std::size_t h = (seq * 2654435761u) >> (32 - HASH_BITS);
+        std::int64_t cand = table[h];
+        table[h] = i;
+        if (cand >= 0 && i - cand <= MAX_OFFSET && load32(src + cand) == seq) {
+            std::size_t len = MIN_MATCH;
+            while (i + len < n && src[cand + len] == src[i + len]) len++;
+            put_sequence(out, src + anchor, i - anchor, i - cand, len);
+            i += len;
+            anchor = i;
+            misses = 0;
+        }
+        else i += 1 + (misses++ >> 6); // Skip faster through incompressible data
+    }
+    put_sequence(out, src + anchor, n - anchor, 0, 0);
+}
+
+// Reads a length continuation; throws on truncated input
+inline std::size_t get_length(const unsigned char*& p, const unsigned char* end) {
+    std::size_t n = 0;
+    unsigned char b;
+    do {
+        if (p == end) throw std::runtime_error("Corrupt compressed block");
+        b = *p++;
+        n += b;
+    } while (b == 255);
+    return n;
+}
+
+// Decompresses a block of n bytes into dst, which must hold exactly raw bytes
+inline void decompress(const char* src, std::size_t n, char* dst, std::size_t raw) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(src);
+    const unsigned char* end = p + n;
+    std::size_t out = 0;
+    while (p < end) {
+        unsigned token = *p++;
+        std::size_t lit = token >> 4;
+        if (lit == 15) lit += get_length(p, end);
+        if (static_cast<std::size_t>(end - p) < lit || raw - out < lit) throw std::runtime_error("Corrupt compressed block");
+        std::memcpy(dst + out, p, lit);
+        p += lit;
+        out += lit;
+        if (p == end) break; // Last sequence
+        if (end - p < 2) throw std::runtime_error("Corrupt compressed block");
+        std::size_t offset = p[0] | (static_cast<std::size_t>(p[1]) << 8);
+        p += 2;
+        std::size_t len = (token & 15) + MIN_MATCH;
+        if ((token & 15) == 15) len += get_length(p, end);
+        if (offset == 0 || offset > out || raw - out < len) throw std::runtime_error("Corrupt compressed block");
+        const char* from = dst + out - offset;
+        for (std::size_t k = 0; k < len; k++) dst[out + k] = from[k]; // Byte-wise: ranges may overlap
+        out += len;
+    }
+    if (out != raw) throw std::runtime_error("Corrupt compressed block");
+}
+
+} // namespace codec
+
+#endif // End of include guard
@@ -0,0 +1,1485 @@
+// commands.hpp
+#ifndef COMMANDS_HPP // Prevents multiple inclusion of this header file
+#define COMMANDS_HPP
+
+#include "file.hpp"      // File class for versioned files
+#include "file_hash.hpp" // ShardedFileTable for mapping filenames to File*
+#include "rank_tree.hpp" // RankTree for the recent and biggest rankings
+#include "storage.hpp"   // Storage for durable mode (WAL and checkpoints)
+#include "rwlock.hpp"    // RwLock guarding whole-state operations
+#include "args.hpp"      // Slice and Args for allocation-free tokenizing
+#include "content_store.hpp" // ContentStore for DEDUP
+#include "compactor.hpp" // Compactor and ContentCache for compressed versions
+#include "diff.hpp"      // Myers diff for DIFF and the three-way merge for MERGE
+#include "gc.hpp"        // GarbageCollector for GC
+#include "spill.hpp"     // Spiller for cold version trees
+#include "stats.hpp"     // Stats for STATS and the periodic dump
+#include "transaction.hpp" // Transaction for BEGIN ... COMMIT and deferred ranking refreshes
+#include <iostream>      // For std::ostream
+#include <iomanip>       // For std::setprecision
+#include <sstream>       // For building the statistics dump
+#include <cstring>       // For std::memcmp
+#include <string>        // For std::string
+#include <vector>        // For std::vector
+#include <unordered_map> // For scanning shared contents once
+#include <algorithm>     // For std::sort
+#include <mutex>         // For std::mutex and std::lock_guard
+#include <chrono>        // For waiting for state_lock in slices
+#include <memory>        // For std::unique_ptr
+#include <atomic>        // For std::atomic
+#include <stdexcept>     // For exception handling
+
+bool use_color = true;           // Wrap output in ANSI colours (off in server mode)
+bool whole_second_times = false; // Print timestamps as whole seconds (--epoch-seconds)
+
+#define ERR_COLOR_YELLOW (use_color ? "\033[33m" : "")
+#define ERR_COLOR_RED (use_color ? "\033[31m" : "")
+#define SUCCESS_COLOR (use_color ? "\033[32m" : "")
+#define RESET_COLOR (use_color ? "\033[0m" : "")
+#define EXIT_COLOR (use_color ? "\033[34m" : "")
+
+// ---------------- SHARED STATE ----------------
+//
+// Commands may run concurrently (server mode). Lock order:
+//   state_lock (shared) -> file_table shard -> File::mutex() -> rank_lock -> Storage
+// Every command holds state_lock shared, and an open transaction holds it for its whole
+// life; checkpoints hold it exclusively to see a consistent state. Files changed by an
+// open transaction are held by it (see Transaction) and waited for by other commands.
+// The rankings are guarded by rank_lock and only read cached keys.
+
+ShardedFileTable file_table;     // Maps filename to File*
+RankTree<RecentCmp> recentTree;  // Files by last modification, newest first
+RankTree<BiggestCmp> biggestTree; // Files by version count, most first
+std::mutex rank_lock;            // Guards both rankings
+RwLock state_lock;               // Shared by commands and open transactions, exclusive for checkpoints
+std::atomic<int> open_transactions(0); // Transactions between BEGIN and their end, across sessions
+
+Storage* storage = nullptr;      // Durable storage, or nullptr when running in memory only
+Compactor* compactor = nullptr;  // Compresses cold versions, or nullptr without --memory-budget
+GarbageCollector* collector = nullptr; // Applies the retention policy (created at startup)
+Spiller* spiller = nullptr;      // Spills cold version trees to disk, or nullptr without --spill-budget
+
+// Updates both rankings with the given file; the caller holds the file's lock. Inside a
+// transaction the file is only marked, and refreshed by refresh_rankings.
+void update_rankings(File* f) {
+    Transaction* t = Transaction::current();
+    if (t) {
+        t->dirty.insert(f);
+        return;
+    }
+    std::lock_guard<std::mutex> guard(rank_lock);
+    recentTree.update(f);
+    biggestTree.update(f);
+}
+
+// Adds a new file to both rankings
+void rank_file(File* f) {
+    std::lock_guard<std::mutex> guard(rank_lock);
+    recentTree.insert(f);
+    biggestTree.insert(f);
+}
+
+// Registers a restored file in the file table, both rankings and the search index
+void register_file(File* f) {
+    f->Index_Versions();
+    file_table.put(f);
+    rank_file(f);
+}
+
+// Reads a spilled file back before a command uses it (the file table's loader with --spill-budget)
+void load_file(File* f) {
+    spiller->use(f);
+}
+
+// Removes a file from both rankings
+void unrank_file(File* f) {
+    std::lock_guard<std::mutex> guard(rank_lock);
+    recentTree.remove(f);
+    biggestTree.remove(f);
+}
+
+// Refreshes the rankings of the files a transaction changed: one update of each, or, for
+// a transaction that is not atomic (--batch, where nothing else runs), a rebuild of both
+// trees once they are most of the files. A committing transaction only reads the files it
+// holds, since other commands may be changing the rest.
+void refresh_rankings(Transaction& t) {
+    if (t.dirty.empty()) return;
+    std::lock_guard<std::mutex> guard(rank_lock);
+    if (!t.atomic && t.dirty.size() * 2 > static_cast<std::size_t>(recentTree.size())) {
+        recentTree.rebuild();
+        biggestTree.rebuild();
+    }
+    else {
+        for (File* f : t.dirty) {
+            recentTree.update(f);
+            biggestTree.update(f);
+        }
+    }
+    t.dirty.clear();
+}
+
+// Lets the current transaction record a file's state before a command changes it; the
+// caller holds the file's lock
+void changing(File* f) {
+    Transaction* t = Transaction::current();
+    if (t) t->changing(f);
+}
+
+// Ranks a file just created, under its shard lock, or lets the current transaction record
+// it, hold it and rank it when it commits
+void note_created(File* f) {
+    Transaction* t = Transaction::current();
+    if (!t || !t->created(f)) rank_file(f);
+}
+
+// Frees a file removed from the table, or hands it to the current transaction, which
+// frees it once it commits or puts it back if it rolls back; f arrives locked
+void discard_file(File* f) {
+    f->mutex().unlock();
+    Transaction* t = Transaction::current();
+    if (!t || !t->deleted(f)) delete f;
+}
+
+// Appends a successful mutation to the WAL when running in durable mode. Called while
+// holding the file's lock (or its shard's lock for CREATE/DELETE), so the per-file order
+// of WAL records matches the order in which mutations were applied.
+// Inside an atomic transaction the record is held until COMMIT (see Storage::log_batch).
+void wal_log(WalOp op, const std::string& fname, const std::string& arg = "", int version = -1) {
+    if (!storage) return;
+    Transaction* t = Transaction::current();
+    if (t && t->atomic) t->records.push_back(WalRecord{0, op, Clock::now(), fname, arg, version});
+    else storage->log(WalRecord{0, op, Clock::now(), fname, arg, version});
+}
+
+// Waits until the WAL records the calling thread logged are on disk (see Storage); called
+// before output reporting them is released. Throws if an fsync failed.
+inline void await_durable() {
+    if (storage) storage->wait_synced();
+}
+
+// Logs the versions garbage collection removed from a file, as space-separated IDs
+void log_removed(File* f, const std::vector<int>& removed) {
+    if (!storage) return;
+    std::string ids;
+    for (int id : removed) {
+        if (!ids.empty()) ids += ' ';
+        ids += std::to_string(id);
+    }
+    wal_log(WAL_GC, f->get_filename(), ids);
+}
+
+// Applies a WAL_MERGE record: the logged content is used as is, so replay does not merge again
+void apply_merge(File* f, int v1, const std::string& arg) {
+    std::size_t space = arg.find(' ');
+    Args args(Slice(arg.data(), space == std::string::npos ? arg.size() : space));
+    int v2;
+    if (space == std::string::npos || !args.integer(v2)) throw std::runtime_error("Corrupt WAL: bad merge record");
+    f->Merge(v1, v2, arg.substr(space + 1));
+}
+
+// Parses the version IDs of a WAL_GC record
+std::vector<int> parse_removed(const std::string& ids) {
+    std::vector<int> removed;
+    Args args(Slice(ids.data(), ids.size()));
+    int id;
+    while (args.integer(id)) removed.push_back(id);
+    return removed;
+}
+
+// Encodes the versions a clone starts with for its WAL_CLONE record: a count, then each
+// version's created and snapshot times, message and content (expanded if packed)
+std::string encode_clone(const std::vector<VersionState>& chain) {
+    Encoder e;
+    e.put<std::uint32_t>(chain.size());
+    for (const VersionState& s : chain) {
+        e.put<std::int64_t>(s.created);
+        e.put<std::int64_t>(s.snapshotted);
+        e.put_str(s.message);
+        e.put_str(s.packed ? s.packed->unpack().str() : s.content.str());
+    }
+    return e.buf;
+}
+
+// Decodes the versions of a WAL_CLONE record
+std::vector<VersionState> decode_clone(const std::string& arg) {
+    Decoder d(arg.data(), arg.data() + arg.size());
+    std::vector<VersionState> chain(d.get<std::uint32_t>());
+    for (VersionState& s : chain) {
+        s.created = d.get<std::int64_t>();
+        s.snapshotted = d.get<std::int64_t>();
+        s.message = d.get_str();
+        s.content = Rope(d.get_str());
+    }
+    return chain;
+}
+
+// Creates dst from the versions of a clone, oldest first (see File::Clone_From). Unless it
+// is being replayed, the clone is logged with the versions themselves, so replay does not
+// depend on what the source holds by then. Returns false if dst already exists.
+bool create_clone(const std::string& dst, const std::vector<VersionState>& chain, bool replay) {
+    std::string logged = replay || !storage ? "" : encode_clone(chain); // Outside the shard lock
+    bool created = file_table.create(dst, [&](File* f) {
+        f->Clone_From(chain);
+        note_created(f);
+        if (!replay) wal_log(WAL_CLONE, dst, logged);
+    });
+    if (created && TextIndex::instance().enabled()) {
+        LockedFile f(file_table, dst);
+        if (f) f->Index_Versions();
+    }
+    return created;
+}
+
+// Creates dst as a clone of a version of src (see File::Version_Chain). The source is
+// unlocked before dst is created, keeping the shard -> file lock order. Returns the number
+// of versions dst starts with, or 0 if it already exists; throws if src or the version
+// does not exist.
+std::size_t clone_file(const std::string& src, const std::string& dst, int version, bool history) {
+    std::vector<VersionState> chain;
+    {
+        LockedFile f(file_table, src);
+        if (!f) throw std::invalid_argument("File '" + src + "' not found.");
+        if (version < 0) version = f->get_active_version()->get_version_id();
+        chain = f->Version_Chain(version, history);
+    }
+    return create_clone(dst, chain, false) ? chain.size() : 0;
+}
+
+// Re-applies a logged mutation during recovery, with the clock pinned to its logged time
+void apply_record(const WalRecord& r) {
+    Clock::observe(r.time);
+    Clock::Pin pin(r.time);
+    if (r.op == WAL_CREATE) {
+        file_table.create(r.file, rank_file);
+        return;
+    }
+    if (r.op == WAL_CLONE) {
+        std::vector<VersionState> chain = decode_clone(r.arg);
+        if (chain.empty()) throw std::runtime_error("Corrupt WAL: empty clone of '" + r.file + "'");
+        if (!create_clone(r.file, chain, true)) {
+            throw std::runtime_error("Corrupt WAL: file '" + r.file + "' already exists");
+        }
+        return;
+    }
+    if (r.op == WAL_DELETE) {
+        File* f = file_table.remove(r.file, unrank_file); // Returned locked
+        if (!f) throw std::runtime_error("Corrupt WAL: file '" + r.file + "' not found");
+        f->mutex().unlock();
+        delete f;
+        return;
+    }
+    LockedFile f(file_table, r.file);
+    if (!f) throw std::runtime_error("Corrupt WAL: file '" + r.file + "' not found");
+    switch (r.op) {
+        case WAL_INSERT: f->Insert(r.arg); update_rankings(f.get()); break;
+        case WAL_UPDATE: f->Update(r.arg); update_rankings(f.get()); break;
+        case WAL_SNAPSHOT: f->Snapshot(r.arg); break;
+        case WAL_ROLLBACK: f->Rollback(r.version); break;
+        case WAL_GC: f->Remove_Versions(parse_removed(r.arg)); break;
+        case WAL_MERGE: apply_merge(f.get(), r.version, r.arg); update_rankings(f.get()); break;
+        default: throw std::runtime_error("Corrupt WAL: unknown operation");
+    }
+}
+
+// Writes a checkpoint of every file, unless a transaction is open: it holds state_lock
+// shared until it ends, and a waiting writer holds back every new reader, so waiting for
+// it would stall every other command meanwhile. A BEGIN counts itself before it takes
+// state_lock, so the lock is waited for in short slices that give up once one is counted,
+// and the count is checked again once the lock is held. Returns false if skipped. The
+// caller must not hold state_lock.
+bool take_checkpoint() {
+    do {
+        if (open_transactions > 0) return false;
+    } while (!state_lock.try_lock_for(std::chrono::milliseconds(10)));
+    std::lock_guard<RwLock> exclusive(state_lock, std::adopt_lock);
+    if (open_transactions > 0) return false; // A BEGIN is waiting for state_lock
+    storage->checkpoint(file_table);
+    return true;
+}
+
+// ---------------- COMMAND HANDLERS ----------------
+//
+// Each handler writes its reply to out and returns true if the command succeeded.
+
+// CREATE
+bool handle_create(Args& args, std::ostream& out) {
+    std::string fname;
+    if (!(args.word(fname))) {
+        out << ERR_COLOR_YELLOW << "Error: Invalid command. Usage: CREATE <filename>" << std::endl << RESET_COLOR;
+        return false;
+    }
+    bool created = file_table.create(fname, [&](File* f) {
+        note_created(f);
+        wal_log(WAL_CREATE, fname);
+    });
+    if (!created) {
+        out << ERR_COLOR_YELLOW << "Error: File '" << fname << "' already exists." << std::endl << RESET_COLOR;
+        return false;
+    }
+    out << SUCCESS_COLOR << "File '" << fname << "' created successfully." << std::endl << RESET_COLOR;
+    return true;
+}
+
+// CLONE
+bool handle_clone(Args& args, std::ostream& out) {
+    std::string src, dst, opt;
+    int version = -1;
+    bool history = false, has_version = false;
+    bool valid = args.word(src) && args.word(dst);
+    while (valid && args.word(opt)) {
+        if (opt == "--history" && !history) {history = true; continue;}
+        Args num(Slice(opt.data(), opt.size()));
+        valid = !has_version && !history && num.integer(version);
+        has_version = true;
+    }
+    if (!valid) {
+        out << ERR_COLOR_YELLOW << "Error: Invalid command. Usage: CLONE <source> <destination> [versionID] [--history]" << std::endl << RESET_COLOR;
+        return false;
+    }
+    if (has_version && version < 0) {
+        out << ERR_COLOR_YELLOW << "Error: VersionID must be non-negative." << std::endl << RESET_COLOR;
+        return false;
+    }
+    {
+        LockedFile f(file_table, src); // Checked here for the error message; clone_file checks again
+        if (!f) {
+            out << ERR_COLOR_YELLOW << "Error: File '" << src << "' not found." << std::endl << RESET_COLOR;
+            return false;
+        }
+        if (has_version && !f->get_version(version)) {
+            out << ERR_COLOR_YELLOW << "Error: Version " << version
+                << " not found for file '" << src << "'." << std::endl << RESET_COLOR;
+            return false;
+        }
+    }
+    std::size_t versions = clone_file(src, dst, version, history);
+    if (!versions) {
+        out << ERR_COLOR_YELLOW << "Error: File '" << dst << "' already exists." << std::endl << RESET_COLOR;
+        return false;
+    }
+    out << SUCCESS_COLOR << "File '" << dst << "' cloned from '" << src << "' with "
+        << versions << " version(s); active version is " << versions - 1 << "." << std::endl << RESET_COLOR;
+    return true;
+}
+
+// READ
+bool handle_read(Args& args, std::ostream& out) {
+    std::string fname;
+    if (!(args.word(fname))) {
+        out << ERR_COLOR_YELLOW << "Error: Invalid command. Usage: READ <filename>" << std::endl << RESET_COLOR;
+        return false;
+    }
+    int version;
+    Rope content; // O(1) copy; lets the file be unlocked while the content is written out
+    {
+        LockedFile f(file_table, fname);
+        if (!f) {
+            out << ERR_COLOR_YELLOW << "Error: File '" << fname << "' not found." << std::endl << RESET_COLOR;
+            return false;
+        }
+        version = f->get_active_version()->get_version_id();
+        content = f->get_active_version()->read_content();
+    }
+    out << SUCCESS_COLOR << "Content of '" << fname << "' (Version "
+        << version << "):" << std::endl
+        << content << "" << std::endl << RESET_COLOR; // Streams pieces without flattening
+    return true;
+}
+
+// READ_AT / ROLLBACK_AT
+bool handle_time_travel(Args& args, std::ostream& out, bool is_rollback) {
+    std::string fname, when;
+    Clock::time_point lo, hi;
+    if (!(args.word(fname) && args.word(when) && Clock::parse(when, lo, hi))) {
+        out << ERR_COLOR_YELLOW << "Error: Invalid command. Usage: "
+            << (is_rollback ? "ROLLBACK_AT" : "READ_AT") << " <filename> <timestamp>" << std::endl << RESET_COLOR;
+        return false;
+    }
+    int version;
+    Rope content;
+    {
+        LockedFile f(file_table, fname);
+        if (!f) {
+            out << ERR_COLOR_YELLOW << "Error: File '" << fname << "' not found." << std::endl << RESET_COLOR;
+            return false;
+        }
+        version = f->Version_At(hi); // The state at the end of the span the timestamp names
+        if (version < 0) {
+            out << ERR_COLOR_YELLOW << "Error: File '" << fname << "' did not exist at " << when << " (created at ";
+            Clock::write(out, f->get_created_time(), whole_second_times);
+            out << ")." << std::endl << RESET_COLOR;
+            return false;
+        }
+        TreeNode* node = f->get_version(version);
+        if (!node) {
+            out << ERR_COLOR_YELLOW << "Error: Version " << version << ", active at " << when
+                << ", was reclaimed by garbage collection." << std::endl << RESET_COLOR;
+            return false;
+        }
+        if (is_rollback) {
+            changing(f.get());
+            f->Rollback(version);
+            wal_log(WAL_ROLLBACK, fname, "", version);
+        }
+        else content = node->read_content();
+    }
+    if (is_rollback) {
+        out << SUCCESS_COLOR << "Active version for '" << fname << "' set to " << version
+            << ", the version active at " << when << "." << std::endl << RESET_COLOR;
+    }
+    else {
+        out << SUCCESS_COLOR << "Content of '" << fname << "' at " << when << " (Version "
+            << version << "):" << std::endl
+            << content << "" << std::endl << RESET_COLOR;
+    }
+    return true;
+}
+
+// INSERT / UPDATE
+bool handle_insert_update(Args& args, std::ostream& out, bool is_insert) {
+    std::string fname;
+    if (!(args.word(fname))) {
+        out << ERR_COLOR_YELLOW << "Error: Invalid command. Usage: "
+            << (is_insert ? "INSERT" : "UPDATE") << " <filename> <content>" << std::endl << RESET_COLOR;
+        return false;
+    }
+    std::string content;
+    args.rest(content);
+    if (content.empty() || content == " ") {
+        out << ERR_COLOR_YELLOW << "Error: Invalid command. Usage: "
+            << (is_insert ? "INSERT" : "UPDATE") << " <filename> <content>" << std::endl << RESET_COLOR;
+        return false;
+    }
+    if (content[0] == ' ') content.erase(0,1);
+
+    LockedFile f(file_table, fname);
+    if (!f) {
+        out << ERR_COLOR_YELLOW << "Error: File '" << fname << "' not found." << std::endl << RESET_COLOR;
+        return false;
+    }
+
+    changing(f.get());
+    if (is_insert) f->Insert(content);
+    else f->Update(content);
+
+    update_rankings(f.get());
+    wal_log(is_insert ? WAL_INSERT : WAL_UPDATE, fname, content);
+
+    TreeNode* active = f->get_active_version();
+    TreeNode* parent = active->get_parent();
+    out << SUCCESS_COLOR << "New version " << active->get_version_id()
+        << " created for '" << fname
+        << "'. Parent is version "
+        << (parent ? parent->get_version_id() : -1)
+        << "." << std::endl << RESET_COLOR;
+    return true;
+}
+
+// SNAPSHOT
+bool handle_snapshot(Args& args, std::ostream& out) {
+    std::string fname;
+    if (!(args.word(fname))) {
+        out << ERR_COLOR_YELLOW << "Error: Invalid command. Usage: SNAPSHOT <filename> <message>" << std::endl << RESET_COLOR;
+        return false;
+    }
+    std::string message;
+    args.rest(message);
+    if (message.empty() || message == " ") {
+        out << ERR_COLOR_YELLOW << "Error: Invalid command. Usage: SNAPSHOT <filename> <message>" << std::endl << RESET_COLOR;
+        return false;
+    }
+    if (message[0] == ' ') message.erase(0,1);
+
+    LockedFile f(file_table, fname);
+    if (!f) {
+        out << ERR_COLOR_YELLOW << "Error: File '" << fname << "' not found." << std::endl << RESET_COLOR;
+        return false;
+    }
+
+    try {
+        changing(f.get());
+        f->Snapshot(message);
+        wal_log(WAL_SNAPSHOT, fname, message);
+        out << SUCCESS_COLOR << "Snapshot created for '" << fname
+            << "' with message: " << message << "" << std::endl << RESET_COLOR;
+        return true;
+    } catch (const std::exception& e) {
+        out << ERR_COLOR_YELLOW << "Error: " << e.what() << "" << std::endl << RESET_COLOR;
+        return false;
+    }
+}
+
+// ROLLBACK
+bool handle_rollback(Args& args, std::ostream& out) {
+    std::string fname;
+    if (!(args.word(fname))) {
+        out << ERR_COLOR_YELLOW << "Error: Invalid command. Usage: ROLLBACK <filename> [versionID]" << std::endl << RESET_COLOR;
+        return false;
+    }
+    LockedFile f(file_table, fname);
+    if (!f) {
+        out << ERR_COLOR_YELLOW << "Error: File '" << fname << "' not found." << std::endl << RESET_COLOR;
+        return false;
+    }
+
+    int versionID;
+    if (args.integer(versionID)) {
+        if (versionID < 0) {
+            out << ERR_COLOR_YELLOW << "Error: VersionID must be non-negative." << std::endl << RESET_COLOR;
+            return false;
+        }
+        try {
+            changing(f.get());
+            f->Rollback(versionID);
+            wal_log(WAL_ROLLBACK, fname, "", versionID);
+            out << SUCCESS_COLOR << "Active version for '" << fname
+                << "' set to " << versionID << "." << std::endl << RESET_COLOR;
+            return true;
+        } catch (...) {
+            out << ERR_COLOR_YELLOW << "Error: Version " << versionID
+                << " not found for file '" << fname << "'." << std::endl << RESET_COLOR;
+            return false;
+        }
+    } else {
+        TreeNode* active = f->get_active_version();
+        TreeNode* parent = (active ? active->get_parent() : nullptr);
+        if (!parent) {
+            out << ERR_COLOR_YELLOW << "Error: Cannot rollback from root version." << std::endl << RESET_COLOR;
+            return false;
+        }
+        int parentID = parent->get_version_id();
+        try {
+            changing(f.get());
+            f->Rollback();
+            wal_log(WAL_ROLLBACK, fname, "", parentID);
+            out << SUCCESS_COLOR << "Active version for '" << fname
+                << "' set to parent version " << parentID << "." << std::endl << RESET_COLOR;
+            return true;
+        } catch (const std::exception& e) {
+            out << ERR_COLOR_YELLOW << "Error: " << e.what() << "" << std::endl << RESET_COLOR;
+            return false;
+        }
+    }
+}
+
+// HISTORY
+bool handle_history(Args& args, std::ostream& out) {
+    std::string fname;
+    if (!(args.word(fname))) {
+        out << ERR_COLOR_YELLOW << "Error: Invalid command. Usage: HISTORY <filename> [limit] [offset]" << std::endl << RESET_COLOR;
+        return false;
+    }
+    int limit = -1, offset = 0;
+    if (args.integer(limit)) {
+        if (limit <= 0) {
+            out << ERR_COLOR_YELLOW << "Error: Invalid command. limit must be positive." << std::endl << RESET_COLOR;
+            return false;
+        }
+        if (args.integer(offset) && offset < 0) {
+            out << ERR_COLOR_YELLOW << "Error: Invalid command. offset must be non-negative." << std::endl << RESET_COLOR;
+            return false;
+        }
+    }
+    LockedFile f(file_table, fname);
+    if (!f) {
+        out << ERR_COLOR_YELLOW << "Error: File '" << fname << "' not found." << std::endl << RESET_COLOR;
+        return false;
+    }
+    auto hist = f->History(limit, offset);
+    for (auto* node : hist) {
+        out << node->get_version_id() << " ";
+        Clock::write(out, node->get_snapshot_time(), whole_second_times);
+        out << " " << node->get_message() << "" << std::endl;
+    }
+    return true;
+}
+
+// DIFF
+bool handle_diff(Args& args, std::ostream& out) {
+    std::string fname, mode;
+    int v1, v2;
+    if (!(args.word(fname) && args.integer(v1) && args.integer(v2))
+        || (args.word(mode) && mode != "words" && mode != "bytes")) {
+        out << ERR_COLOR_YELLOW << "Error: Invalid command. Usage: DIFF <filename> <version1> <version2> [words|bytes]" << std::endl << RESET_COLOR;
+        return false;
+    }
+    if (v1 < 0 || v2 < 0) {
+        out << ERR_COLOR_YELLOW << "Error: VersionID must be non-negative." << std::endl << RESET_COLOR;
+        return false;
+    }
+    int ancestor;
+    Rope a, b; // O(1) copies; the diff runs with the file unlocked
+    {
+        LockedFile f(file_table, fname);
+        if (!f) {
+            out << ERR_COLOR_YELLOW << "Error: File '" << fname << "' not found." << std::endl << RESET_COLOR;
+            return false;
+        }
+        for (int v : {v1, v2}) {
+            if (!f->get_version(v)) {
+                out << ERR_COLOR_YELLOW << "Error: Version " << v
+                    << " not found for file '" << fname << "'." << std::endl << RESET_COLOR;
+                return false;
+            }
+        }
+        ancestor = f->Common_Ancestor(v1, v2)->get_version_id();
+        a = f->get_version(v1)->read_content();
+        b = f->get_version(v2)->read_content();
+    }
+
+    std::vector<diff::Hunk> hunks;
+    std::string sa, sb;
+    if (!a.same_content(b)) {
+        sa = a.str();
+        sb = b.str();
+        hunks = mode == "bytes" ? diff::bytes(sa, sb) : diff::words(sa, sb);
+    }
+    std::size_t removed = 0, added = 0;
+    for (const diff::Hunk& h : hunks) {
+        removed += h.a_end - h.a_begin;
+        added += h.b_end - h.b_begin;
+    }
+    out << SUCCESS_COLOR << "Diff for '" << fname << "' from version " << v1 << " to version " << v2
+        << " (common ancestor: version " << ancestor << "): " << hunks.size() << " hunk(s), "
+        << removed << " byte(s) removed, " << added << " byte(s) added." << std::endl << RESET_COLOR;
+    for (const diff::Hunk& h : hunks) {
+        out << "@@ -" << h.a_begin << "," << h.a_end - h.a_begin
+            << " +" << h.b_begin << "," << h.b_end - h.b_begin << " @@" << std::endl;
+        if (h.a_end > h.a_begin) {
+            out << "-";
+            out.write(sa.data() + h.a_begin, h.a_end - h.a_begin);
+            out << std::endl;
+        }
+        if (h.b_end > h.b_begin) {
+            out << "+";
+            out.write(sb.data() + h.b_begin, h.b_end - h.b_begin);
+            out << std::endl;
+        }
+    }
+    return true;
+}
+
+// MERGE
+bool handle_merge(Args& args, std::ostream& out) {
+    std::string fname;
+    int v1, v2;
+    if (!(args.word(fname) && args.integer(v1) && args.integer(v2))) {
+        out << ERR_COLOR_YELLOW << "Error: Invalid command. Usage: MERGE <filename> <version1> <version2>" << std::endl << RESET_COLOR;
+        return false;
+    }
+    if (v1 < 0 || v2 < 0) {
+        out << ERR_COLOR_YELLOW << "Error: VersionID must be non-negative." << std::endl << RESET_COLOR;
+        return false;
+    }
+    int ancestor;
+    std::uint64_t incarnation; // The merge is only applied to the File it was computed from
+    Rope base, a, b; // O(1) copies of snapshotted (immutable) contents; the merge runs with the file unlocked
+    {
+        LockedFile f(file_table, fname);
+        if (!f) {
+            out << ERR_COLOR_YELLOW << "Error: File '" << fname << "' not found." << std::endl << RESET_COLOR;
+            return false;
+        }
+        for (int v : {v1, v2}) {
+            if (!f->get_version(v)) {
+                out << ERR_COLOR_YELLOW << "Error: Version " << v
+                    << " not found for file '" << fname << "'." << std::endl << RESET_COLOR;
+                return false;
+            }
+            if (!f->get_version(v)->is_snapshot()) {
+                out << ERR_COLOR_YELLOW << "Error: Version " << v << " of '" << fname
+                    << "' must be snapshotted before it is merged." << std::endl << RESET_COLOR;
+                return false;
+            }
+        }
+        TreeNode* common = f->Common_Ancestor(v1, v2);
+        ancestor = common->get_version_id();
+        if (ancestor == v2) {
+            out << ERR_COLOR_YELLOW << "Error: Version " << v2 << " is already merged into version "
+                << v1 << " of '" << fname << "'." << std::endl << RESET_COLOR;
+            return false;
+        }
+        incarnation = f->get_incarnation();
+        base = common->read_content();
+        a = f->get_version(v1)->read_content();
+        b = f->get_version(v2)->read_content();
+    }
+
+    diff::MergeResult merged = diff::merge3(base.str(), a.str(), b.str());
+    if (!merged.conflicts.empty()) {
+        std::string sb = base.str(), sa = a.str(), sv = b.str();
+        out << ERR_COLOR_YELLOW << "Error: Merging version " << v2 << " into version " << v1 << " of '" << fname
+            << "' (common ancestor: version " << ancestor << ") has " << merged.conflicts.size()
+            << " conflict(s); no version was created." << std::endl << RESET_COLOR;
+        for (const diff::Conflict& c : merged.conflicts) { // Ancestor's text, then each side's
+            out << "@@ " << c.base_begin << "," << c.base_end - c.base_begin << " @@" << std::endl;
+            if (c.base_end > c.base_begin) {
+                out << "=";
+                out.write(sb.data() + c.base_begin, c.base_end - c.base_begin);
+                out << std::endl;
+            }
+            if (c.a_end > c.a_begin) {
+                out << "<";
+                out.write(sa.data() + c.a_begin, c.a_end - c.a_begin);
+                out << std::endl;
+            }
+            if (c.b_end > c.b_begin) {
+                out << ">";
+                out.write(sv.data() + c.b_begin, c.b_end - c.b_begin);
+                out << std::endl;
+            }
+        }
+        return false;
+    }
+
+    LockedFile f(file_table, fname);
+    if (!f) {
+        out << ERR_COLOR_YELLOW << "Error: File '" << fname << "' not found." << std::endl << RESET_COLOR;
+        return false;
+    }
+    if (f->get_incarnation() != incarnation) { // Deleted and created again while merging
+        out << ERR_COLOR_YELLOW << "Error: File '" << fname << "' was replaced while merging; no version was created."
+            << std::endl << RESET_COLOR;
+        return false;
+    }
+    try {
+        changing(f.get());
+        TreeNode* node = f->Merge(v1, v2, merged.text); // Throws if GC removed either version meanwhile
+        update_rankings(f.get());
+        wal_log(WAL_MERGE, fname, std::to_string(v2) + " " + merged.text, v1);
+        out << SUCCESS_COLOR << "New version " << node->get_version_id() << " created for '" << fname
+            << "' by merging version " << v2 << " into version " << v1 << " (common ancestor: version "
+            << ancestor << "). Parents are versions " << v1 << " and " << v2 << "." << std::endl << RESET_COLOR;
+        return true;
+    } catch (const std::exception& e) {
+        out << ERR_COLOR_YELLOW << "Error: " << e.what() << "" << std::endl << RESET_COLOR;
+        return false;
+    }
+}
+
+// SEARCH
+bool handle_search(Args& args, std::ostream& out) {
+    static const std::string ALL_FLAG = " --all-versions";
+    std::string pattern;
+    args.rest(pattern);
+    bool all_versions = pattern.size() >= ALL_FLAG.size()
+        && pattern.compare(pattern.size() - ALL_FLAG.size(), ALL_FLAG.size(), ALL_FLAG) == 0;
+    if (all_versions) pattern.erase(pattern.size() - ALL_FLAG.size());
+    if (!pattern.empty() && pattern[0] == ' ') pattern.erase(0, 1);
+    if (pattern.empty()) {
+        out << ERR_COLOR_YELLOW << "Error: Invalid command. Usage: SEARCH <pattern> [--all-versions]" << std::endl << RESET_COLOR;
+        return false;
+    }
+
+    // Candidate files: from the index when it can narrow them down, otherwise every file
+    TextIndex& index = TextIndex::instance();
+    bool indexed = index.enabled() && pattern.size() >= 3;
+    std::vector<std::pair<std::uint32_t, std::string>> candidates;
+    if (indexed) candidates = index.candidates(pattern);
+    else {
+        for (std::string& name : file_table.keys()) candidates.emplace_back(0, std::move(name));
+    }
+
+    // Verify each candidate; contents are copied under the file lock and scanned outside it.
+    // A spilled tree is read from its spill file without being taken back, so a search
+    // does not bring every cold file into memory.
+    std::vector<std::pair<std::string, std::vector<int>>> matches; // File -> matching versions
+    for (const auto& c : candidates) {
+        std::vector<std::pair<int, Rope>> versions;
+        {
+            LockedFile f(file_table, c.second, false);
+            if (!f || (indexed && f->get_search_id() != c.first)) continue; // Deleted or re-created
+            std::unique_ptr<File> on_disk;
+            if (f->Is_Spilled()) on_disk = Spiller::read_back(*f.get());
+            const File* tree = on_disk ? on_disk.get() : f.get();
+            if (!all_versions) versions.emplace_back(tree->get_active_version()->get_version_id(), tree->get_active_version()->get_content());
+            else {
+                for (int id = 0; id < f->get_total_versions(); id++) {
+                    TreeNode* node = tree->get_version(id);
+                    if (node) versions.emplace_back(id, node->get_content());
+                }
+            }
+        }
+        std::vector<int> found;
+        std::unordered_map<const void*, bool> checked; // Shared contents are scanned once
+        for (const auto& v : versions) {
+            auto it = checked.find(v.second.identity());
+            bool hit = it != checked.end() ? it->second : rope_contains(v.second, pattern);
+            if (v.second.identity()) checked[v.second.identity()] = hit;
+            if (hit) found.push_back(v.first);
+        }
+        if (!found.empty()) matches.emplace_back(c.second, std::move(found));
+    }
+    std::sort(matches.begin(), matches.end());
+
+    out << SUCCESS_COLOR << "Found '" << pattern << "' in " << matches.size() << " file(s) ("
+        << candidates.size() << " candidate(s) checked" << (indexed ? " via the index" : "") << ")."
+        << std::endl << RESET_COLOR;
+    for (const auto& m : matches) {
+        if (!all_versions) out << m.first << " (Version " << m.second[0] << ")" << std::endl;
+        else {
+            out << m.first << ":";
+            for (int v : m.second) out << " " << v;
+            out << std::endl;
+        }
+    }
+    return true;
+}
+
+// DELETE
+bool handle_delete(Args& args, std::ostream& out) {
+    std::string fname;
+    if (!(args.word(fname))) {
+        out << ERR_COLOR_YELLOW << "Error: Invalid command. Usage: DELETE <filename>" << std::endl << RESET_COLOR;
+        return false;
+    }
+    Transaction* t = Transaction::current();
+    Transaction* keep = t && t->atomic ? t : nullptr; // Unranked when it commits
+    File* f = file_table.remove(fname, [&](File* removed) { // Returned locked
+        if (!keep) unrank_file(removed);
+        wal_log(WAL_DELETE, fname);
+    }, keep);
+    if (!f) {
+        out << ERR_COLOR_YELLOW << "Error: File '" << fname << "' not found." << std::endl << RESET_COLOR;
+        return false;
+    }
+    discard_file(f);
+    out << SUCCESS_COLOR << "File '" << fname << "' deleted successfully." << std::endl << RESET_COLOR;
+    return true;
+}
+
+// CHECKPOINT (runs outside state_lock, see dispatch_command)
+bool handle_checkpoint(std::ostream& out) {
+    if (!storage) {
+        out << ERR_COLOR_YELLOW << "Error: Durable mode is off. Start with --data-dir <dir>." << std::endl << RESET_COLOR;
+        return false;
+    }
+    if (!take_checkpoint()) {
+        out << ERR_COLOR_YELLOW << "Error: " << open_transactions << " transaction(s) open; try again once they end." << std::endl << RESET_COLOR;
+        return false;
+    }
+    out << SUCCESS_COLOR << "Checkpoint written (" << file_table.size() << " file(s))." << std::endl << RESET_COLOR;
+    return true;
+}
+
+// MEMORY
+bool handle_memory(Args& args, std::ostream& out) {
+    std::string fname;
+    if (!(args.word(fname))) {
+        out << ERR_COLOR_YELLOW << "Error: Invalid command. Usage: MEMORY <filename>" << std::endl << RESET_COLOR;
+        return false;
+    }
+    LockedFile f(file_table, fname);
+    if (!f) {
+        out << ERR_COLOR_YELLOW << "Error: File '" << fname << "' not found." << std::endl << RESET_COLOR;
+        return false;
+    }
+    MemoryStats m = f->Memory_Usage();
+    out << SUCCESS_COLOR << "Memory for '" << fname << "': " << m.versions << " version(s), "
+        << m.logical_bytes << " logical bytes, " << m.stored_bytes << " stored bytes ("
+        << m.allocated_bytes << " allocated), " << m.stored_bytes / m.versions << " bytes/version."
+        << std::endl << RESET_COLOR;
+    return true;
+}
+
+// DEDUP
+bool handle_dedup(std::ostream& out) {
+    DedupStats st = ContentStore::instance().stats();
+    double ratio = st.unique_bytes ? static_cast<double>(st.logical_bytes) / st.unique_bytes : 1.0;
+    std::ios::fmtflags flags = out.flags();
+    out << SUCCESS_COLOR << "Content store: " << st.blobs << " distinct content(s) shared by "
+        << st.references << " version(s), " << st.logical_bytes << " logical bytes, "
+        << st.unique_bytes << " unique bytes, dedup ratio " << std::fixed << std::setprecision(2) << ratio
+        << " (" << st.hits << " of " << st.lookups << " snapshot(s) matched existing content)." << std::endl << RESET_COLOR;
+    out.flags(flags);
+    return true;
+}
+
+// GC (runs outside state_lock, see dispatch_command)
+bool handle_gc(Args& args, std::ostream& out) {
+    std::string fname;
+    ReclaimStats r;
+    int files = 1;
+    if (args.word(fname)) {
+        if (!collector->sweep(fname, r)) {
+            out << ERR_COLOR_YELLOW << "Error: File '" << fname << "' not found." << std::endl << RESET_COLOR;
+            return false;
+        }
+    }
+    else {
+        files = file_table.size();
+        r = collector->sweep();
+    }
+    CollectorStats st = collector->stats();
+    out << SUCCESS_COLOR << "Reclaimed " << r.versions << " version(s) and " << r.bytes << " byte(s) from "
+        << files << " file(s) (" << st.versions << " version(s), " << st.bytes << " byte(s) in "
+        << st.sweeps << " sweep(s) since startup)." << std::endl << RESET_COLOR;
+    return true;
+}
+
+// COMPACT (runs outside state_lock, see dispatch_command)
+bool handle_compact(std::ostream& out) {
+    if (!compactor) {
+        out << ERR_COLOR_YELLOW << "Error: Compression is off. Start with --memory-budget <MiB>." << std::endl << RESET_COLOR;
+        return false;
+    }
+    CompactorStats before = compactor -> stats();
+    compactor -> run_pass();
+    CompactorStats after = compactor -> stats();
+    out << SUCCESS_COLOR << "Compacted " << after.versions_packed - before.versions_packed << " version(s), "
+        << after.resident_bytes << " uncompressed bytes left." << std::endl << RESET_COLOR;
+    return true;
+}
+
+// COMPRESSION
+bool handle_compression(std::ostream& out) {
+    if (!compactor) {
+        out << ERR_COLOR_YELLOW << "Error: Compression is off. Start with --memory-budget <MiB>." << std::endl << RESET_COLOR;
+        return false;
+    }
+    CompactorStats st = compactor -> stats();
+    CacheStats cs = ContentCache::instance().stats();
+    double ratio = st.packed_bytes ? static_cast<double>(st.raw_bytes) / st.packed_bytes : 1.0;
+    double avg_us = cs.misses ? static_cast<double>(cs.decompress_us) / cs.misses : 0.0;
+    std::ios::fmtflags flags = out.flags();
+    out << SUCCESS_COLOR << std::fixed << std::setprecision(2)
+        << "Compression: " << st.versions_packed << " version(s) compressed, " << st.raw_bytes << " -> "
+        << st.packed_bytes << " bytes (ratio " << ratio << "), " << st.resident_bytes << " of "
+        << compactor -> get_budget() << " budget bytes uncompressed after " << st.passes << " pass(es)." << std::endl
+        << "Cache: " << cs.hits << " hit(s), " << cs.misses << " miss(es), " << cs.cached_bytes << " of "
+        << cs.budget_bytes << " bytes, decompression " << avg_us << " us avg, " << cs.max_decompress_us << " us max."
+        << std::endl << RESET_COLOR;
+    out.flags(flags);
+    return true;
+}
+
+// SPILL (runs outside state_lock, see dispatch_command)
+bool handle_spill(std::ostream& out) {
+    if (!spiller) {
+        out << ERR_COLOR_YELLOW << "Error: Spilling is off. Start with --spill-budget <MiB>." << std::endl << RESET_COLOR;
+        return false;
+    }
+    SpillStats before = spiller -> stats();
+    spiller -> run_pass();
+    SpillStats st = spiller -> stats();
+    double avg_us = st.loads ? static_cast<double>(st.load_us) / st.loads : 0.0;
+    std::ios::fmtflags flags = out.flags();
+    out << SUCCESS_COLOR << std::fixed << std::setprecision(2)
+        << "Spilled " << st.spills - before.spills << " file(s); " << st.spilled_files << " file(s) on disk, "
+        << st.resident_files << " in memory holding " << st.resident_bytes << " of " << spiller -> get_budget()
+        << " budget bytes." << std::endl
+        << "Since startup: " << st.spills << " spill(s) of " << st.spilled_bytes << " bytes, " << st.loads
+        << " load(s), load " << avg_us << " us avg, " << st.max_load_us << " us max." << std::endl << RESET_COLOR;
+    out.flags(flags);
+    return true;
+}
+
+// Brings the rankings up to date with the changes deferred by the running transaction,
+// unless it is atomic: its changes only reach the rankings when it commits
+void flush_rankings() {
+    Transaction* t = Transaction::current();
+    if (t && !t->atomic) refresh_rankings(*t);
+}
+
+// Writes ranked files one per line with their keys; the caller holds rank_lock
+template <typename Key>
+void write_ranked(const std::vector<std::pair<File*, Key>>& results, std::ostream& out, bool is_recent) {
+    for (const auto& r : results) {
+        out << SUCCESS_COLOR << r.first->get_filename() << " ";
+        if (is_recent) Clock::write(out, r.second, whole_second_times);
+        else out << r.second;
+        out << "" << std::endl << RESET_COLOR;
+    }
+}
+
+// RECENT_FILES / BIGGEST_TREES
+template <typename Compare>
+bool handle_top_query(RankTree<Compare>& tree, Args& args, std::ostream& out, bool is_recent) {
+    int num, offset = 0;
+    if (!(args.integer(num))) {
+        out << ERR_COLOR_YELLOW << "Error: Invalid command. Usage: "
+            << (is_recent ? "RECENT_FILES <k> [offset]" : "BIGGEST_TREES <k> [offset]") << "" << std::endl << RESET_COLOR;
+        return false;
+    }
+    if (num <= 0) {
+        out << ERR_COLOR_YELLOW << "Error: Invalid command. k must be positive." << std::endl << RESET_COLOR;
+        return false;
+    }
+    if (args.integer(offset) && offset < 0) {
+        out << ERR_COLOR_YELLOW << "Error: Invalid command. offset must be non-negative." << std::endl << RESET_COLOR;
+        return false;
+    }
+    flush_rankings();
+    std::lock_guard<std::mutex> guard(rank_lock); // Ranked files stay alive while it is held
+    if (num > tree.size()) {
+        out << ERR_COLOR_YELLOW << "Error: k cannot exceed number of files. Currently only "
+            << tree.size() << " file(s) exist." << std::endl << RESET_COLOR;
+        return false;
+    }
+    if (offset > 0 && offset >= tree.size()) {
+        out << ERR_COLOR_YELLOW << "Error: Offset " << offset << " is past the last file. Currently only "
+            << tree.size() << " file(s) exist." << std::endl << RESET_COLOR;
+        return false;
+    }
+    write_ranked(tree.top_k(num, offset), out, is_recent); // The last page may be shorter
+    return true;
+}
+
+// RANK
+bool handle_rank(Args& args, std::ostream& out) {
+    std::string fname;
+    if (!(args.word(fname))) {
+        out << ERR_COLOR_YELLOW << "Error: Invalid command. Usage: RANK <filename>" << std::endl << RESET_COLOR;
+        return false;
+    }
+    flush_rankings();
+    LockedFile f(file_table, fname, false); // Keys and names only, so a spilled file stays on disk
+    if (!f) {
+        out << ERR_COLOR_YELLOW << "Error: File '" << fname << "' not found." << std::endl << RESET_COLOR;
+        return false;
+    }
+    std::lock_guard<std::mutex> guard(rank_lock);
+    out << SUCCESS_COLOR << "Rank of '" << fname << "': " << biggestTree.rank(f.get()) << " of " << biggestTree.size()
+        << " by version count (" << f->get_total_versions() << " version(s)), " << recentTree.rank(f.get()) << " of "
+        << recentTree.size() << " by last modification (";
+    Clock::write(out, f->get_last_modified(), whole_second_times);
+    out << ")." << std::endl << RESET_COLOR;
+    return true;
+}
+
+// RANGE_RECENT
+bool handle_range_recent(Args& args, std::ostream& out) {
+    std::string from, to;
+    Clock::time_point from_lo, from_hi, to_lo, to_hi;
+    if (!(args.word(from) && args.word(to) && Clock::parse(from, from_lo, from_hi) && Clock::parse(to, to_lo, to_hi))) {
+        out << ERR_COLOR_YELLOW << "Error: Invalid command. Usage: RANGE_RECENT <from> <to>" << std::endl << RESET_COLOR;
+        return false;
+    }
+    if (from_lo > to_hi) {
+        out << ERR_COLOR_YELLOW << "Error: Invalid command. <from> must not be later than <to>." << std::endl << RESET_COLOR;
+        return false;
+    }
+    flush_rankings();
+    std::lock_guard<std::mutex> guard(rank_lock);
+    auto results = recentTree.between(to_hi, from_lo); // Newest first, both spans included
+    out << SUCCESS_COLOR << results.size() << " file(s) modified from " << from << " to " << to << ":" << std::endl << RESET_COLOR;
+    write_ranked(results, out, true);
+    return true;
+}
+
+// COUNT_ABOVE
+bool handle_count_above(Args& args, std::ostream& out) {
+    int min_versions;
+    std::string flag;
+    if (!(args.integer(min_versions)) || (args.word(flag) && flag != "--list")) {
+        out << ERR_COLOR_YELLOW << "Error: Invalid command. Usage: COUNT_ABOVE <versions> [--list]" << std::endl << RESET_COLOR;
+        return false;
+    }
+    flush_rankings();
+    std::lock_guard<std::mutex> guard(rank_lock);
+    int count = biggestTree.count_above(min_versions, false);
+    out << SUCCESS_COLOR << count << " of " << biggestTree.size() << " file(s) have more than " << min_versions
+        << " version(s)" << (flag.empty() ? "." : ":") << std::endl << RESET_COLOR;
+    if (!flag.empty()) write_ranked(biggestTree.top_k(count, 0), out, false); // Most versions first
+    return true;
+}
+
+// ---------------- COMMAND TABLE ----------------
+
+// Command names understood by dispatch_command
+enum CommandId {
+    CMD_UNKNOWN, CMD_CREATE, CMD_CLONE, CMD_READ, CMD_INSERT, CMD_UPDATE, CMD_SNAPSHOT, CMD_ROLLBACK,
+    CMD_READ_AT, CMD_ROLLBACK_AT, CMD_HISTORY, CMD_DELETE, CMD_MEMORY, CMD_DEDUP, CMD_DIFF, CMD_MERGE, CMD_SEARCH, CMD_GC, CMD_COMPACT, CMD_COMPRESSION, CMD_SPILL, CMD_CHECKPOINT, CMD_RECENT_FILES, CMD_BIGGEST_TREES, CMD_RANK, CMD_RANGE_RECENT, CMD_COUNT_ABOVE, CMD_STATS,
+    CMD_BEGIN, CMD_COMMIT, CMD_ABORT, CMD_EXIT, CMD_COUNT
+};
+static_assert(CMD_COUNT <= Stats::MAX_COMMANDS, "Stats records too few command ids");
+
+// Command names by id, as reported by STATS
+const char* const COMMAND_NAMES[CMD_COUNT] = {
+    "(unknown)", "CREATE", "CLONE", "READ", "INSERT", "UPDATE", "SNAPSHOT", "ROLLBACK",
+    "READ_AT", "ROLLBACK_AT", "HISTORY", "DELETE", "MEMORY", "DEDUP", "DIFF", "MERGE", "SEARCH", "GC", "COMPACT", "COMPRESSION", "SPILL", "CHECKPOINT", "RECENT_FILES", "BIGGEST_TREES", "RANK", "RANGE_RECENT", "COUNT_ABOVE", "STATS",
+    "BEGIN", "COMMIT", "ABORT", "EXIT"
+};
+
+// Returns true if the slice holds exactly the given name
+inline bool slice_is(Slice s, const char* name) {
+    return std::memcmp(s.p, name, s.n) == 0; // Lengths already matched by the caller
+}
+
+// Maps a command name to its id. Names are told apart by length and first letter (and the
+// second where those collide), so a lookup costs one switch and at most one memcmp.
+inline CommandId lookup_command(Slice s) {
+    if (s.empty()) return CMD_UNKNOWN;
+    switch (s.n) {
+        case 2: return slice_is(s, "GC") ? CMD_GC : CMD_UNKNOWN;
+        case 4:
+            if (s.p[0] == 'R' && s.p[1] == 'E') return slice_is(s, "READ") ? CMD_READ : CMD_UNKNOWN;
+            if (s.p[0] == 'R') return slice_is(s, "RANK") ? CMD_RANK : CMD_UNKNOWN;
+            if (s.p[0] == 'D') return slice_is(s, "DIFF") ? CMD_DIFF : CMD_UNKNOWN;
+            if (s.p[0] == 'E') return slice_is(s, "EXIT") ? CMD_EXIT : CMD_UNKNOWN;
+            return CMD_UNKNOWN;
+        case 5:
+            if (s.p[0] == 'D') return slice_is(s, "DEDUP") ? CMD_DEDUP : CMD_UNKNOWN;
+            if (s.p[0] == 'C') return slice_is(s, "CLONE") ? CMD_CLONE : CMD_UNKNOWN;
+            if (s.p[0] == 'S' && s.p[1] == 'T') return slice_is(s, "STATS") ? CMD_STATS : CMD_UNKNOWN;
+            if (s.p[0] == 'S') return slice_is(s, "SPILL") ? CMD_SPILL : CMD_UNKNOWN;
+            if (s.p[0] == 'B') return slice_is(s, "BEGIN") ? CMD_BEGIN : CMD_UNKNOWN;
+            if (s.p[0] == 'A') return slice_is(s, "ABORT") ? CMD_ABORT : CMD_UNKNOWN;
+            if (s.p[0] == 'M') return slice_is(s, "MERGE") ? CMD_MERGE : CMD_UNKNOWN;
+            return CMD_UNKNOWN;
+        case 6:
+            switch (s.p[0]) {
+                case 'C':
+                    if (s.p[1] == 'R') return slice_is(s, "CREATE") ? CMD_CREATE : CMD_UNKNOWN;
+                    return slice_is(s, "COMMIT") ? CMD_COMMIT : CMD_UNKNOWN;
+                case 'I': return slice_is(s, "INSERT") ? CMD_INSERT : CMD_UNKNOWN;
+                case 'U': return slice_is(s, "UPDATE") ? CMD_UPDATE : CMD_UNKNOWN;
+                case 'D': return slice_is(s, "DELETE") ? CMD_DELETE : CMD_UNKNOWN;
+                case 'M': return slice_is(s, "MEMORY") ? CMD_MEMORY : CMD_UNKNOWN;
+                case 'S': return slice_is(s, "SEARCH") ? CMD_SEARCH : CMD_UNKNOWN;
+                default: return CMD_UNKNOWN;
+            }
+        case 7:
+            if (s.p[0] == 'H') return slice_is(s, "HISTORY") ? CMD_HISTORY : CMD_UNKNOWN;
+            if (s.p[0] == 'C') return slice_is(s, "COMPACT") ? CMD_COMPACT : CMD_UNKNOWN;
+            if (s.p[0] == 'R') return slice_is(s, "READ_AT") ? CMD_READ_AT : CMD_UNKNOWN;
+            return CMD_UNKNOWN;
+        case 8:
+            if (s.p[0] == 'S') return slice_is(s, "SNAPSHOT") ? CMD_SNAPSHOT : CMD_UNKNOWN;
+            if (s.p[0] == 'R') return slice_is(s, "ROLLBACK") ? CMD_ROLLBACK : CMD_UNKNOWN;
+            return CMD_UNKNOWN;
+        case 10: return slice_is(s, "CHECKPOINT") ? CMD_CHECKPOINT : CMD_UNKNOWN;
+        case 11:
+            if (s.p[0] == 'C' && s.p[2] == 'U') return slice_is(s, "COUNT_ABOVE") ? CMD_COUNT_ABOVE : CMD_UNKNOWN;
+            if (s.p[0] == 'C') return slice_is(s, "COMPRESSION") ? CMD_COMPRESSION : CMD_UNKNOWN;
+            if (s.p[0] == 'R') return slice_is(s, "ROLLBACK_AT") ? CMD_ROLLBACK_AT : CMD_UNKNOWN;
+            return CMD_UNKNOWN;
+        case 12:
+            if (s.p[1] == 'E') return slice_is(s, "RECENT_FILES") ? CMD_RECENT_FILES : CMD_UNKNOWN;
+            return slice_is(s, "RANGE_RECENT") ? CMD_RANGE_RECENT : CMD_UNKNOWN;
+        case 13: return slice_is(s, "BIGGEST_TREES") ? CMD_BIGGEST_TREES : CMD_UNKNOWN;
+        default: return CMD_UNKNOWN;
+    }
+}
+
+// Writes the statistics as one JSON object on one line, for the periodic dump
+void write_stats_json(std::ostream& out) {
+    StatsSnapshot s = Stats::instance().snapshot();
+    std::ostringstream line;
+    line << std::fixed << std::setprecision(3) << "{\"time\":";
+    Clock::write(line, Clock::tick(), false);
+    line << ",\"seconds\":" << s.seconds << ",\"commands\":{";
+    bool first = true;
+    for (int c = 0; c < CMD_COUNT; c++) {
+        std::uint64_t n = s.count(c);
+        if (!n) continue;
+        line << (first ? "" : ",") << "\"" << COMMAND_NAMES[c] << "\":{\"count\":" << n
+             << ",\"mean_us\":" << s.mean_ns(c) / 1000 << ",\"p50_us\":" << s.percentile_ns(c, 0.5) / 1000.0
+             << ",\"p99_us\":" << s.percentile_ns(c, 0.99) / 1000.0 << ",\"p999_us\":" << s.percentile_ns(c, 0.999) / 1000.0
+             << ",\"max_us\":" << s.percentile_ns(c, 1.0) / 1000.0 << "}";
+        first = false;
+    }
+    line << "},\"copied\":{\"insert\":{\"calls\":" << s.v[Stats::COPIES + Stats::COPY_INSERT]
+         << ",\"bytes\":" << s.v[Stats::COPIED_BYTES + Stats::COPY_INSERT] << "},\"update\":{\"calls\":"
+         << s.v[Stats::COPIES + Stats::COPY_UPDATE] << ",\"bytes\":" << s.v[Stats::COPIED_BYTES + Stats::COPY_UPDATE] << "}}";
+    const char* names[2] = {"rank_depths", "hash_probes"};
+    const std::size_t bases[2] = {Stats::RANK_DEPTHS, Stats::PROBES};
+    for (int i = 0; i < 2; i++) {
+        std::uint64_t n;
+        double mean;
+        int max;
+        s.depths(bases[i], n, mean, max);
+        line << ",\"" << names[i] << "\":{\"count\":" << n << ",\"mean\":" << mean << ",\"max\":" << max << "}";
+    }
+    line << "}\n";
+    out << line.str() << std::flush;
+}
+
+// STATS [reset]
+bool handle_stats(Args& args, std::ostream& out) {
+    std::string word;
+    bool reset = args.word(word);
+    if (reset && word != "reset") {
+        out << ERR_COLOR_YELLOW << "Error: Invalid command. Usage: STATS [reset]" << std::endl << RESET_COLOR;
+        return false;
+    }
+    if (!Stats::ENABLED) {
+        out << ERR_COLOR_YELLOW << "Error: Statistics were compiled out. Build without -DNO_STATS." << std::endl << RESET_COLOR;
+        return false;
+    }
+    if (reset) {
+        Stats::instance().reset();
+        out << SUCCESS_COLOR << "Statistics reset." << std::endl << RESET_COLOR;
+        return true;
+    }
+    StatsSnapshot s = Stats::instance().snapshot();
+    std::ios::fmtflags flags = out.flags();
+    out << SUCCESS_COLOR << std::fixed << std::setprecision(2) << "Statistics over " << s.seconds << " s:" << std::endl
+        << std::left << std::setw(14) << "Command" << std::right << std::setw(10) << "count" << std::setw(11) << "mean us"
+        << std::setw(11) << "p50 us" << std::setw(11) << "p99 us" << std::setw(11) << "p999 us" << std::setw(11) << "max us" << std::endl;
+    for (int c = 0; c < CMD_COUNT; c++) {
+        std::uint64_t n = s.count(c);
+        if (!n) continue;
+        out << std::left << std::setw(14) << COMMAND_NAMES[c] << std::right << std::setw(10) << n
+            << std::setw(11) << s.mean_ns(c) / 1000 << std::setw(11) << s.percentile_ns(c, 0.5) / 1000.0
+            << std::setw(11) << s.percentile_ns(c, 0.99) / 1000.0 << std::setw(11) << s.percentile_ns(c, 0.999) / 1000.0
+            << std::setw(11) << s.percentile_ns(c, 1.0) / 1000.0 << std::endl;
+    }
+    std::uint64_t ranks, probes;
+    double rank_mean, probe_mean;
+    int rank_max, probe_max;
+    s.depths(Stats::RANK_DEPTHS, ranks, rank_mean, rank_max);
+    s.depths(Stats::PROBES, probes, probe_mean, probe_max);
+    out << "Copied: INSERT " << s.v[Stats::COPIES + Stats::COPY_INSERT] << " call(s), "
+        << s.v[Stats::COPIED_BYTES + Stats::COPY_INSERT] << " byte(s); UPDATE " << s.v[Stats::COPIES + Stats::COPY_UPDATE]
+        << " call(s), " << s.v[Stats::COPIED_BYTES + Stats::COPY_UPDATE] << " byte(s)." << std::endl
+        << "Ranking insertions: " << ranks << ", mean " << rank_mean << " level(s) deep, max " << rank_max << "." << std::endl
+        << "File table lookups: " << probes << ", mean " << probe_mean << " slot(s) probed past home, max "
+        << probe_max << "." << std::endl << RESET_COLOR;
+    out.flags(flags);
+    return true;
+}
+
+// Outcome of run_command
+enum CommandStatus {COMMAND_DONE, COMMAND_FAILED, COMMAND_EXIT};
+
+// Returns true for the commands that change files; in a transaction, their failure fails it
+inline bool changes_files(CommandId id) {
+    switch (id) {
+        case CMD_CREATE: case CMD_CLONE: case CMD_INSERT: case CMD_UPDATE: case CMD_SNAPSHOT:
+        case CMD_ROLLBACK: case CMD_ROLLBACK_AT: case CMD_DELETE: case CMD_MERGE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Runs a command that takes no lock of its own; the caller holds state_lock shared, or
+// an open transaction does
+CommandStatus run_command(CommandId id, Args& args, Slice cmd, std::ostream& out) {
+    bool ok;
+    switch (id) {
+        case CMD_CREATE: ok = handle_create(args, out); break;
+        case CMD_CLONE: ok = handle_clone(args, out); break;
+        case CMD_READ: ok = handle_read(args, out); break;
+        case CMD_INSERT: ok = handle_insert_update(args, out, true); break;
+        case CMD_UPDATE: ok = handle_insert_update(args, out, false); break;
+        case CMD_SNAPSHOT: ok = handle_snapshot(args, out); break;
+        case CMD_ROLLBACK: ok = handle_rollback(args, out); break;
+        case CMD_READ_AT: ok = handle_time_travel(args, out, false); break;
+        case CMD_ROLLBACK_AT: ok = handle_time_travel(args, out, true); break;
+        case CMD_HISTORY: ok = handle_history(args, out); break;
+        case CMD_DELETE: ok = handle_delete(args, out); break;
+        case CMD_MEMORY: ok = handle_memory(args, out); break;
+        case CMD_DEDUP: ok = handle_dedup(out); break;
+        case CMD_DIFF: ok = handle_diff(args, out); break;
+        case CMD_MERGE: ok = handle_merge(args, out); break;
+        case CMD_SEARCH: ok = handle_search(args, out); break;
+        case CMD_COMPRESSION: ok = handle_compression(out); break;
+        case CMD_RECENT_FILES: ok = handle_top_query(recentTree, args, out, true); break;
+        case CMD_BIGGEST_TREES: ok = handle_top_query(biggestTree, args, out, false); break;
+        case CMD_RANK: ok = handle_rank(args, out); break;
+        case CMD_RANGE_RECENT: ok = handle_range_recent(args, out); break;
+        case CMD_COUNT_ABOVE: ok = handle_count_above(args, out); break;
+        case CMD_STATS: ok = handle_stats(args, out); break;
+        case CMD_EXIT:
+            out << EXIT_COLOR << "Exiting shell. Goodbye!" << std::endl << RESET_COLOR;
+            return COMMAND_EXIT;
+        default:
+            out << ERR_COLOR_RED << "Error: Unknown command '";
+            out.write(cmd.p, cmd.n);
+            out << "'." << std::endl << RESET_COLOR;
+            ok = false;
+    }
+    return ok ? COMMAND_DONE : COMMAND_FAILED;
+}
+
+// ---------------- TRANSACTIONS ----------------
+
+// Rolls a transaction back and lets go of its files
+void roll_back(Transaction& t) {
+    Transaction::Scope scope(t);
+    t.rollback(file_table);
+    t.release(file_table);
+}
+
+// Session is what dispatch_command keeps for one client (the shell, a batch run or a
+// connection) between commands: the transaction opened by BEGIN, if any, and the shared
+// hold on state_lock it keeps until it ends. Ending the session rolls it back.
+struct Session {
+    std::unique_ptr<SharedLock> state; // Held while txn is open
+    std::unique_ptr<Transaction> txn;  // Open transaction, or null
+
+    Session() {}
+    Session(const Session&) = delete;
+    Session& operator=(const Session&) = delete;
+    ~Session();
+
+    // Ends the transaction, which has committed or rolled back
+    void close() {
+        txn.reset();
+        state.reset();
+        open_transactions--;
+    }
+};
+
+Session::~Session() {
+    if (!txn) return;
+    try {
+        if (!txn->failed_at) roll_back(*txn);
+    } catch (std::exception& e) {
+        std::cerr << "Error: rolling back an open transaction failed: " << e.what() << std::endl;
+    }
+    close();
+}
+
+// Runs a command in the session's open transaction; it is applied right away, and the
+// files it changes stay held until the transaction ends. The first command that changes
+// files and fails rolls the whole transaction back; later commands are then refused until
+// COMMIT or ABORT ends it. Commands that take state_lock themselves, and BEGIN, are refused
+// and the transaction goes on.
+void run_in_transaction(Session& session, CommandId id, Args& args, Slice cmd, std::ostream& out) {
+    Transaction& t = *session.txn;
+    if (t.failed_at) {
+        out << ERR_COLOR_YELLOW << "Error: Transaction was rolled back at command " << t.failed_at
+            << "; end it with COMMIT or ABORT." << std::endl << RESET_COLOR;
+        return;
+    }
+    if (id == CMD_BEGIN) {
+        out << ERR_COLOR_YELLOW << "Error: A transaction is already open." << std::endl << RESET_COLOR;
+        return;
+    }
+    if (id == CMD_CHECKPOINT || id == CMD_COMPACT || id == CMD_GC || id == CMD_SPILL) {
+        out << ERR_COLOR_YELLOW << "Error: " << COMMAND_NAMES[id] << " cannot run inside a transaction." << std::endl << RESET_COLOR;
+        return;
+    }
+    Transaction::Scope scope(t);
+    t.commands++;
+    bool ok = false;
+    try {
+        ok = run_command(id, args, cmd, out) != COMMAND_FAILED;
+    } catch (std::exception& e) {
+        out << ERR_COLOR_YELLOW << "Error: " << e.what() << std::endl << RESET_COLOR;
+    }
+    if (ok && changes_files(id)) t.applied++;
+    if (ok || !changes_files(id)) return; // Failed queries are only reported
+    roll_back(t);
+    t.failed_at = t.commands;
+    out << ERR_COLOR_YELLOW << "Error: Transaction rolled back at command " << t.failed_at
+        << "; nothing was applied. End it with COMMIT or ABORT." << std::endl << RESET_COLOR;
+}
+
+// BEGIN: opens a transaction, holding state_lock shared until it ends so that no
+// checkpoint sees its changes before they are committed or undone. It is counted before
+// it takes state_lock, so a checkpoint about to wait for the lock gives up instead (see
+// take_checkpoint). Changes deferred by an enclosing non-atomic transaction (--batch)
+// reach the rankings first: flush_rankings leaves them alone while the atomic one runs.
+void handle_begin(Session& session, std::ostream& out) {
+    flush_rankings();
+    open_transactions++;
+    session.state.reset(new SharedLock(state_lock));
+    session.txn.reset(new Transaction(true));
+    out << SUCCESS_COLOR << "Transaction started." << std::endl << RESET_COLOR;
+}
+
+// ABORT
+void handle_abort(Session& session, std::ostream& out) {
+    if (!session.txn) {
+        out << ERR_COLOR_YELLOW << "Error: No transaction is open." << std::endl << RESET_COLOR;
+        return;
+    }
+    std::size_t n = session.txn->failed_at ? 0 : session.txn->applied;
+    if (!session.txn->failed_at) roll_back(*session.txn);
+    session.close();
+    out << SUCCESS_COLOR << "Transaction aborted; " << n << " command(s) undone." << std::endl << RESET_COLOR;
+}
+
+// COMMIT: writes the WAL records of the transaction's commands as one, then removes the
+// files it deleted, brings the rankings up to date once and releases its files. A
+// transaction already rolled back, or whose records cannot be written, ends with nothing
+// applied.
+void handle_commit(Session& session, std::ostream& out) {
+    if (!session.txn) {
+        out << ERR_COLOR_YELLOW << "Error: No transaction is open." << std::endl << RESET_COLOR;
+        return;
+    }
+    Transaction& t = *session.txn;
+    bool failed = t.failed_at != 0;
+    if (!failed && storage) {
+        try {
+            storage->log_batch(t.records);
+        } catch (std::exception& e) {
+            out << ERR_COLOR_YELLOW << "Error: " << e.what() << std::endl << RESET_COLOR;
+            roll_back(t);
+            failed = true;
+        }
+    }
+    if (failed) {
+        out << ERR_COLOR_YELLOW << "Error: Transaction rolled back";
+        if (t.failed_at) out << " at command " << t.failed_at;
+        out << "; nothing was applied." << std::endl << RESET_COLOR;
+    }
+    else {
+        t.publish(file_table, rank_file, unrank_file);
+        refresh_rankings(t);
+        t.release(file_table);
+        out << SUCCESS_COLOR << "Transaction committed; " << t.applied << " command(s) applied." << std::endl << RESET_COLOR;
+    }
+    session.close();
+}
+
+// ---------------- DISPATCH ----------------
+
+// Runs one command line and writes its output to out; safe to call from many threads,
+// each with its own session. Returns false if the line asks to end the session (EXIT).
+bool dispatch_command(Slice line, std::ostream& out, Session& session) {
+    if (line.empty()) return true;
+    Args args(line);
+    Slice cmd;
+    args.word(cmd);
+    CommandId id = lookup_command(cmd);
+    Stats::CommandTimer timer(id);
+    Clock::Pin pin(Clock::tick()); // Every timestamp of this command is identical and logged as such
+
+    try {
+        if (session.txn && id != CMD_COMMIT && id != CMD_ABORT && id != CMD_EXIT) {
+            run_in_transaction(session, id, args, cmd, out); // Under the transaction's hold on state_lock
+            return true;
+        }
+        if (id == CMD_CHECKPOINT) {
+            handle_checkpoint(out); // Takes state_lock exclusively
+            return true;
+        }
+        if (id == CMD_COMPACT) {
+            handle_compact(out); // Takes state_lock per file
+            return true;
+        }
+        if (id == CMD_SPILL) {
+            handle_spill(out); // Takes state_lock per file
+            return true;
+        }
+        if (id == CMD_GC) {
+            handle_gc(args, out); // Takes state_lock per file
+            if (storage && storage->checkpoint_due()) take_checkpoint();
+            return true;
+        }
+        if (id == CMD_BEGIN) {
+            handle_begin(session, out);
+            return true;
+        }
+        if (id == CMD_ABORT || (id == CMD_EXIT && session.txn)) handle_abort(session, out);
+        if (id == CMD_ABORT) return true;
+        if (id == CMD_COMMIT) handle_commit(session, out);
+        else {
+            SharedLock shared(state_lock);
+            if (run_command(id, args, cmd, out) == COMMAND_EXIT) return false;
+        }
+        if (storage && storage->checkpoint_due()) take_checkpoint();
+    }
+    catch (std::exception& e) {
+        out << ERR_COLOR_YELLOW << "Error: " << e.what() << "" << std::endl << RESET_COLOR;
+    }
+    return true;
+}
+
+#endif // End of include guard
@@ -0,0 +1,186 @@
+// compactor.hpp
+#ifndef COMPACTOR_HPP // Prevents multiple inclusion of this header file
+#define COMPACTOR_HPP
+
+#include "file_hash.hpp"     // ShardedFileTable and LockedFile
+#include "rwlock.hpp"        // RwLock and SharedLock
+#include "content_cache.hpp" // PackedContent
+#include "periodic.hpp"      // PeriodicWorker
+#include <string>            // For std::string
+#include <vector>            // For std::vector
+#include <unordered_map>     // For grouping versions by content
+#include <algorithm>         // For std::sort
+#include <mutex>             // For std::mutex
+#include <atomic>            // For the counters
+#include <chrono>            // For the pass interval
+#include <cstdint>           // For std::uint64_t
+#include <cstddef>           // For std::size_t
+
+// CompactorStats reports what the compactor has done
+struct CompactorStats {
+    std::uint64_t passes = 0;            // Passes run
+    std::uint64_t versions_packed = 0;   // Versions whose content was replaced by a compressed one
+    std::uint64_t raw_bytes = 0;         // Content bytes compressed
+    std::uint64_t packed_bytes = 0;      // ... and their compressed size
+    std::size_t resident_bytes = 0;      // Uncompressed snapshotted bytes after the last pass
+};
+
+// Compactor compresses the contents of cold snapshotted versions. Snapshotted contents
+// never change, so they can be swapped for a compressed copy at any time and expanded
+// again (through ContentCache) when read. Each pass measures the uncompressed snapshotted
+// content held in memory; while it exceeds the budget, the contents read least recently
+// are compressed first. Versions sharing one content (see ContentStore) are compressed
+// together, since memory is only freed once none of them holds it uncompressed.
+// Contents that live in a mapped checkpoint are left alone (they are not heap memory).
+// A background thread runs a pass every interval; run_pass() can also be called directly.
+class Compactor {
+private:
+    static constexpr std::size_t MIN_BYTES = 64; // Smaller contents are not worth compressing
+
+    ShardedFileTable& table;
+    RwLock& state_lock;         // Held shared while touching versions (checkpoints hold it exclusively)
+    std::size_t budget;         // Target for uncompressed snapshotted bytes
+    std::chrono::milliseconds interval;
+
+    std::mutex pass_lock;       // Serializes passes (background and on demand)
+    std::unordered_map<const void*, Rope> incompressible; // Contents that did not shrink (held so their
+                                                          // address is not reused); guarded by pass_lock
+    std::atomic<std::uint64_t> passes, versions_packed, raw_bytes, packed_bytes;
+    std::atomic<std::size_t> resident;
+    PeriodicWorker worker;      // Runs passes in the background once started
+
+    // One version that may be compressed
+    struct Candidate {
+        std::string file;
+        int version;
+    };
+    // Versions sharing one content
+    struct Group {
+        std::vector<Candidate> versions;
+        Clock::time_point last_read = 0; // Most recent read of any of them
+        std::size_t size = 0;
+    };
+
+    // Returns the node if it can still be compressed and holds the given content
+    static TreeNode* eligible(File* f, int version, const void* identity) {
+        TreeNode* node = f -> get_version(version);
+        if (!node || !node -> is_snapshot() || node -> is_packed()) return nullptr;
+        if (node -> get_content().identity() != identity) return nullptr;
+        return node;
+    }
+
+public:
+    Compactor(ShardedFileTable& files, RwLock& state, std::size_t budget_bytes,
+              std::chrono::milliseconds every = std::chrono::milliseconds(1000))
+        : table(files), state_lock(state), budget(budget_bytes), interval(every),
+          passes(0), versions_packed(0), raw_bytes(0), packed_bytes(0), resident(0),
+          worker("compaction", [this] {run_pass();}) {}
+
+    ~Compactor() {stop();}
+
+    Compactor(const Compactor&) = delete;
+    Compactor& operator=(const Compactor&) = delete;
+
+    // Starts the background thread
+    void start() {worker.start(interval);}
+
+    // Stops the background thread, waiting for a running pass to finish
+    void stop() {worker.stop();}
+
+    // Compresses the coldest snapshotted contents until the uncompressed ones fit the budget.
+    // File locks are only held to inspect or swap a version, never while compressing; files
+    // held by a transaction are skipped.
+    void run_pass() {
+        std::lock_guard<std::mutex> pass_guard(pass_lock);
+        passes++;
+
+        // Collect uncompressed snapshotted contents, grouped by shared piece list
+        std::unordered_map<const void*, Group> groups;
+        std::size_t total = 0;
+        for (const std::string& name : table.keys()) {
+            SharedLock shared(state_lock);
+            LockedFile f(table, name, false, true); // Spilled and held files are left alone
+            if (!f || f -> Is_Spilled()) continue;
+            for (int id = 0; id < f -> get_total_versions(); id++) {
+                TreeNode* node = f -> get_version(id);
+                if (!node || !node -> is_snapshot() || node -> is_packed()) continue;
+                Rope content = node -> get_content();
+                if (content.size() < MIN_BYTES || content.mapped()) continue;
+                Group& g = groups[content.identity()];
+                if (g.versions.empty()) {
+                    g.size = content.size();
+                    total += g.size;
+                }
+                g.versions.push_back(Candidate{name, id});
+                if (node -> get_last_read() > g.last_read) g.last_read = node -> get_last_read();
+            }
+        }
+
+        // Forget incompressible contents no version holds any more
+        for (auto it = incompressible.begin(); it != incompressible.end();) {
+            if (groups.count(it -> first)) ++it;
+            else it = incompressible.erase(it);
+        }
+
+        // Coldest first
+        std::vector<std::pair<const void*, Group*>> order;
+        for (auto& g : groups) {
+            if (!incompressible.count(g.first)) order.emplace_back(g.first, &g.second);
+        }
+        std::sort(order.begin(), order.end(), [](const std::pair<const void*, Group*>& a, const std::pair<const void*, Group*>& b) {
+            return a.second -> last_read < b.second -> last_read;
+        });
+
+        for (const auto& entry : order) {
+            if (total <= budget) break;
+            const void* identity = entry.first;
+            Group& g = *entry.second;
+
+            Rope content; // Copy the content under the lock, compress it outside
+            for (const Candidate& c : g.versions) {
+                SharedLock shared(state_lock);
+                LockedFile f(table, c.file, false, true);
+                TreeNode* node = f ? eligible(f.get(), c.version, identity) : nullptr;
+                if (node) {content = node -> get_content(); break;}
+            }
+            if (content.identity() != identity) continue; // Every version is gone or changed
+
+            std::shared_ptr<const PackedContent> packed = PackedContent::pack(content);
+            if (packed -> bytes.size() >= content.size() - content.size() / 8) { // Saves under 1/8
+                incompressible.emplace(identity, content);
+                continue;
+            }
+            std::size_t swapped = 0;
+            for (const Candidate& c : g.versions) {
+                SharedLock shared(state_lock);
+                LockedFile f(table, c.file, false, true);
+                TreeNode* node = f ? eligible(f.get(), c.version, identity) : nullptr;
+                if (!node) continue;
+                node -> pack(packed);
+                swapped++;
+            }
+            if (!swapped) continue;
+            total -= g.size;
+            versions_packed += swapped;
+            raw_bytes += g.size;
+            packed_bytes += packed -> bytes.size();
+        }
+        resident = total;
+    }
+
+    // Returns the counters
+    CompactorStats stats() const {
+        CompactorStats st;
+        st.passes = passes;
+        st.versions_packed = versions_packed;
+        st.raw_bytes = raw_bytes;
+        st.packed_bytes = packed_bytes;
+        st.resident_bytes = resident;
+        return st;
+    }
+
+    // Returns the budget for uncompressed snapshotted bytes
+    std::size_t get_budget() const {return budget;}
+};
+
+#endif // End of include guard
@@ -0,0 +1,142 @@
+// content_cache.hpp
+#ifndef CONTENT_CACHE_HPP // Prevents multiple inclusion of this header file
+#define CONTENT_CACHE_HPP
+
+#include "rope.hpp"      // Rope, Chunk
+#include "codec.hpp"     // codec::compress / codec::decompress
+#include <string>        // For std::string
+#include <list>          // For the LRU list
+#include <unordered_map> // For the LRU index
+#include <memory>        // For std::shared_ptr
+#include <mutex>         // For std::mutex
+#include <atomic>        // For the counters
+#include <chrono>        // For decompression latency
+#include <cstdint>       // For std::uint64_t
+#include <cstddef>       // For std::size_t
+
+// PackedContent is the compressed form of a version's content
+struct PackedContent {
+    std::string bytes;       // Compressed block (see codec.hpp)
+    std::size_t raw_size;    // Decompressed size
+
+    // Compresses the content of r
+    static std::shared_ptr<const PackedContent> pack(const Rope& r) {
+        std::shared_ptr<PackedContent> p = std::make_shared<PackedContent>();
+        std::string flat = r.str();
+        codec::compress(flat.data(), flat.size(), p -> bytes);
+        p -> bytes.shrink_to_fit();
+        p -> raw_size = flat.size();
+        return p;
+    }
+
+    // Decompresses into a new rope holding one chunk
+    Rope unpack() const {
+        if (raw_size == 0) return Rope();
+        std::string flat(raw_size, '\0');
+        codec::decompress(bytes.data(), bytes.size(), &flat[0], raw_size);
+        Rope::ChunkPtr chunk = Chunk::make_owned(raw_size);
+        chunk -> try_append(0, flat.data(), raw_size);
+        return Rope::from_pieces(std::vector<Rope::Piece>{Rope::Piece{chunk, 0, raw_size}});
+    }
+};
+
+// CacheStats reports the decompression cache and latency
+struct CacheStats {
+    std::uint64_t hits = 0;             // Reads served from the cache
+    std::uint64_t misses = 0;           // Reads that had to decompress
+    std::uint64_t decompress_us = 0;    // Total time spent decompressing
+    std::uint64_t max_decompress_us = 0; // Slowest single decompression
+    std::size_t cached_bytes = 0;       // Decompressed bytes currently cached
+    std::size_t budget_bytes = 0;       // Cache capacity
+};
+
+// ContentCache keeps recently read compressed versions decompressed, evicting the least
+// recently used ones once their total size exceeds the budget. Entries keep their
+// PackedContent alive, so a cached address is never reused by another content.
+class ContentCache {
+private:
+    struct Entry {
+        std::shared_ptr<const PackedContent> packed;
+        Rope content;
+    };
+    typedef std::list<Entry> Lru; // Most recently used first
+
+    std::mutex lock;
+    Lru lru;
+    std::unordered_map<const PackedContent*, Lru::iterator> index;
+    std::size_t bytes;
+    std::size_t budget;
+    std::atomic<std::uint64_t> hits, misses, decompress_us, max_decompress_us;
+
+    // Drops least recently used entries until the cache fits its budget; caller holds lock
+    void evict() {
+        while (bytes > budget && !lru.empty()) {
+            bytes -= lru.back().content.size();
+            index.erase(lru.back().packed.get());
+            lru.pop_back();
+        }
+    }
+
+public:
+    ContentCache() : bytes(0), budget(16u << 20), hits(0), misses(0), decompress_us(0), max_decompress_us(0) {}
+
+    ContentCache(const ContentCache&) = delete;
+    ContentCache& operator=(const ContentCache&) = delete;
+
+    // Returns the process-wide cache
+    static ContentCache& instance() {
+        static ContentCache cache;
+        return cache;
+    }
+
+    // Sets the cache capacity in bytes
+    void set_budget(std::size_t b) {
+        std::lock_guard<std::mutex> guard(lock);
+        budget = b;
+        evict();
+    }
+
+    // Returns the decompressed content of p, from the cache if present
+    Rope get(const std::shared_ptr<const PackedContent>& p) {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            auto it = index.find(p.get());
+            if (it != index.end()) {
+                lru.splice(lru.begin(), lru, it -> second); // Mark most recently used
+                hits++;
+                return it -> second -> content;
+            }
+        }
+        misses++;
+        auto start = std::chrono::steady_clock::now();
+        Rope r = p -> unpack(); // Outside the lock: other reads are not held up
+        std::uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+        decompress_us += us;
+        std::uint64_t prev = max_decompress_us.load();
+        while (prev < us && !max_decompress_us.compare_exchange_weak(prev, us)) {}
+
+        std::lock_guard<std::mutex> guard(lock);
+        if (r.size() <= budget && index.find(p.get()) == index.end()) {
+            lru.push_front(Entry{p, r});
+            index[p.get()] = lru.begin();
+            bytes += r.size();
+            evict();
+        }
+        return r;
+    }
+
+    // Returns the cache counters
+    CacheStats stats() {
+        std::lock_guard<std::mutex> guard(lock);
+        CacheStats st;
+        st.hits = hits;
+        st.misses = misses;
+        st.decompress_us = decompress_us;
+        st.max_decompress_us = max_decompress_us;
+        st.cached_bytes = bytes;
+        st.budget_bytes = budget;
+        return st;
+    }
+};
+
+#endif // End of include guard
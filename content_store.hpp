@@ -0,0 +1,115 @@
+// content_store.hpp
+#ifndef CONTENT_STORE_HPP // Prevents multiple inclusion of this header file
+#define CONTENT_STORE_HPP
+
+#include "rope.hpp"        // Rope and its shared piece lists
+#include <unordered_map>   // For std::unordered_multimap
+#include <memory>          // For std::shared_ptr and std::weak_ptr
+#include <mutex>           // For std::mutex
+#include <atomic>          // For the counters
+#include <cstdint>         // For std::uint64_t
+#include <cstddef>         // For std::size_t
+
+// DedupStats reports how much content the ContentStore shares
+struct DedupStats {
+    std::size_t blobs = 0;          // Distinct interned contents still alive
+    std::size_t references = 0;     // Ropes sharing them
+    std::size_t logical_bytes = 0;  // Bytes summed over all references
+    std::size_t unique_bytes = 0;   // Bytes summed over distinct contents
+    std::uint64_t lookups = 0;      // Contents interned so far
+    std::uint64_t hits = 0;         // ... that matched an existing content
+};
+
+// ContentStore interns immutable contents by hash: interning a rope whose bytes equal an
+// already interned one returns a rope sharing that one's piece list, so versions with
+// equal content keep a single reference-counted copy. Entries hold weak references and
+// disappear when the last version using a content goes away. Interned ropes with equal
+// content always share their piece list, so Rope::same_content on two of them is O(1).
+class ContentStore {
+private:
+    typedef std::unordered_multimap<std::uint64_t, std::weak_ptr<Rope::Rep>> BlobMap;
+
+    // Shard is an independently locked part of the store
+    struct Shard {
+        std::mutex lock;
+        BlobMap blobs;             // Content hash -> interned piece lists
+        std::size_t sweep_at = 64; // Drop expired entries once the map grows past this
+    };
+
+    static constexpr std::size_t SHARDS = 16;
+    Shard shards[SHARDS];
+    std::atomic<std::uint64_t> lookups;
+    std::atomic<std::uint64_t> hits;
+
+    // Removes entries whose content is gone; the caller holds the shard's lock
+    static void sweep(Shard& sh) {
+        for (auto it = sh.blobs.begin(); it != sh.blobs.end();) {
+            if (it -> second.expired()) it = sh.blobs.erase(it);
+            else ++it;
+        }
+        sh.sweep_at = sh.blobs.size() * 2 > 64 ? sh.blobs.size() * 2 : 64;
+    }
+
+public:
+    ContentStore() : lookups(0), hits(0) {}
+
+    ContentStore(const ContentStore&) = delete;
+    ContentStore& operator=(const ContentStore&) = delete;
+
+    // Returns the process-wide store
+    static ContentStore& instance() {
+        static ContentStore store;
+        return store;
+    }
+
+    // Returns a rope with the same content as r that shares its piece list with every
+    // other interned rope of equal content. r must no longer be modified by its owner.
+    // O(1) when no equal content exists or r is already interned; otherwise the bytes are
+    // compared once to rule out a hash collision.
+    Rope intern(const Rope& r) {
+        if (r.empty()) return r;
+        std::uint64_t h = r.content_hash();
+        Shard& sh = shards[h % SHARDS];
+        std::lock_guard<std::mutex> guard(sh.lock);
+        if (r.rep -> interned) return r;
+        lookups++;
+        auto range = sh.blobs.equal_range(h);
+        for (auto it = range.first; it != range.second;) {
+            std::shared_ptr<Rope::Rep> rep = it -> second.lock();
+            if (!rep) {it = sh.blobs.erase(it); continue;}
+            Rope existing;
+            existing.rep = rep;
+            if (existing.equal_bytes(r)) {
+                hits++;
+                return existing;
+            }
+            ++it;
+        }
+        r.rep -> interned = true;
+        sh.blobs.emplace(h, r.rep);
+        if (sh.blobs.size() > sh.sweep_at) sweep(sh);
+        return r;
+    }
+
+    // Walks the store and reports how much content is shared
+    DedupStats stats() {
+        DedupStats st;
+        for (auto& sh : shards) {
+            std::lock_guard<std::mutex> guard(sh.lock);
+            for (const auto& e : sh.blobs) {
+                std::shared_ptr<Rope::Rep> rep = e.second.lock();
+                if (!rep) continue;
+                std::size_t refs = rep.use_count() - 1; // Not counting the one just taken
+                st.blobs++;
+                st.references += refs;
+                st.unique_bytes += rep -> total_size;
+                st.logical_bytes += rep -> total_size * refs;
+            }
+        }
+        st.lookups = lookups;
+        st.hits = hits;
+        return st;
+    }
+};
+
+#endif // End of include guard
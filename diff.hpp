@@ -0,0 +1,241 @@
+// diff.hpp
+#ifndef DIFF_HPP // Prevents multiple inclusion of this header file
+#define DIFF_HPP
+
+#include <string>      // For std::string
+#include <vector>      // For std::vector
+#include <cstring>     // For std::memcmp
+#include <cstdint>     // For std::uint64_t
+#include <cstddef>     // For std::size_t
+#include <algorithm>   // For std::min and std::max
+
+// Myers' O((N+M)D) difference algorithm in its linear-space form (Myers, 1986): each step
+// finds the middle snake of the edit graph by searching forward from the start and
+// backward from the end at once, then recurses on the two halves. Memory is O(N+M) and,
+// after common prefixes and suffixes are stripped, time is O((N+M)D) for D edits. When a
+// search runs past COST_LIMIT edits the split is taken at the furthest point reached, and
+// once WORK_LIMIT search steps are spent the remaining regions are reported as whole
+// replacements, so very different inputs stay fast at the price of a non-minimal script.
+namespace diff {
+
+static constexpr long COST_LIMIT = 1024;     // Edit depth after which a middle snake is approximated
+static constexpr long WORK_LIMIT = 1L << 26;  // Search steps per diff before giving up on minimality
+
+// Hunk is one changed region: a[a_begin, a_end) was replaced by b[b_begin, b_end)
+struct Hunk {
+    std::size_t a_begin, a_end;
+    std::size_t b_begin, b_end;
+};
+
+// Token is one unit compared by the word diff: a run of spaces or a run of other bytes
+struct Token {
+    std::size_t offset;     // Byte offset in its text
+    std::size_t length;
+    std::uint64_t hash;     // FNV-1a of the bytes, compared before them
+};
+
+// Splits text into alternating runs of spaces and non-spaces
+inline std::vector<Token> tokenize(const std::string& text) {
+    std::vector<Token> tokens;
+    std::size_t i = 0, n = text.size();
+    while (i < n) {
+        std::size_t start = i;
+        bool space = text[i] == ' ';
+        std::uint64_t h = 1469598103934665603ULL;
+        while (i < n && (text[i] == ' ') == space) {
+            h = (h ^ static_cast<unsigned char>(text[i])) * 1099511628211ULL;
+            i++;
+        }
+        tokens.push_back(Token{start, i - start, h});
+    }
+    return tokens;
+}
+
+// Differ computes the hunks turning one sequence into another. Eq(i, j) tells whether
+// element i of the first sequence equals element j of the second.
+template <typename Eq>
+class Differ {
+private:
+    Eq eq;
+    std::vector<long> fwd, bwd;  // Furthest x per diagonal, offset by `mid`
+    long mid;
+    long work;                   // Search steps left before regions are replaced whole
+    std::vector<Hunk> hunks;
+
+    // Records that a[a0, a1) was replaced by b[b0, b1), merging with the previous hunk if adjacent
+    void emit(long a0, long a1, long b0, long b1) {
+        if (a0 == a1 && b0 == b1) return;
+        if (!hunks.empty() && hunks.back().a_end == static_cast<std::size_t>(a0) && hunks.back().b_end == static_cast<std::size_t>(b0)) {
+            hunks.back().a_end = a1;
+            hunks.back().b_end = b1;
+            return;
+        }
+        hunks.push_back(Hunk{static_cast<std::size_t>(a0), static_cast<std::size_t>(a1),
+                             static_cast<std::size_t>(b0), static_cast<std::size_t>(b1)});
+    }
+
+    // Finds a middle snake of a[a0, a1) against b[b0, b1), both non-empty with differing
+    // first and last elements. Sets the snake to (x0, y0) -> (x1, y1), relative to a0 and b0.
+    void middle_snake(long a0, long a1, long b0, long b1, long& x0, long& y0, long& x1, long& y1) {
+        long n = a1 - a0, m = b1 - b0, delta = n - m;
+        bool odd = delta & 1;
+        long max_d = (n + m + 1) / 2;
+        fwd[mid + 1] = 0;
+        bwd[mid + 1] = 0;
+        for (long d = 0; d <= max_d; d++) {
+            work -= 2 * d + 2;
+            if (d > COST_LIMIT) { // Give up on minimality: split at the furthest forward point
+                long best = -1;
+                for (long k = -(d - 1); k <= d - 1; k += 2) {
+                    long x = fwd[mid + k] < n ? fwd[mid + k] : n, y = x - k;
+                    if (y < 0 || y > m) continue;
+                    if (x + y > best) {best = x + y; x0 = x1 = x; y0 = y1 = y;}
+                }
+                return;
+            }
+            for (long k = -d; k <= d; k += 2) {
+                long x = (k == -d || (k != d && fwd[mid + k - 1] < fwd[mid + k + 1])) ? fwd[mid + k + 1] : fwd[mid + k - 1] + 1;
+                long y = x - k, sx = x, sy = y;
+                while (x < n && y < m && eq(a0 + x, b0 + y)) {x++; y++;}
+                fwd[mid + k] = x;
+                long r = delta - k; // Same diagonal, seen from the end
+                if (odd && r >= -(d - 1) && r <= d - 1 && x + bwd[mid + r] >= n) {
+                    x0 = sx; y0 = sy; x1 = x; y1 = y;
+                    return;
+                }
+            }
+            for (long k = -d; k <= d; k += 2) {
+                long x = (k == -d || (k != d && bwd[mid + k - 1] < bwd[mid + k + 1])) ? bwd[mid + k + 1] : bwd[mid + k - 1] + 1;
+                long y = x - k, sx = x, sy = y;
+                while (x < n && y < m && eq(a1 - 1 - x, b1 - 1 - y)) {x++; y++;}
+                bwd[mid + k] = x;
+                long f = delta - k;
+                if (!odd && f >= -d && f <= d && x + fwd[mid + f] >= n) {
+                    x0 = n - x; y0 = m - y; x1 = n - sx; y1 = m - sy;
+                    return;
+                }
+            }
+        }
+    }
+
+    // Diffs a[a0, a1) against b[b0, b1)
+    void compare(long a0, long a1, long b0, long b1) {
+        while (a0 < a1 && b0 < b1 && eq(a0, b0)) {a0++; b0++;}         // Common prefix
+        while (a0 < a1 && b0 < b1 && eq(a1 - 1, b1 - 1)) {a1--; b1--;} // Common suffix
+        if (a0 == a1 || b0 == b1 || work <= 0) {
+            emit(a0, a1, b0, b1);
+            return;
+        }
+        long x0, y0, x1, y1;
+        middle_snake(a0, a1, b0, b1, x0, y0, x1, y1);
+        compare(a0, a0 + x0, b0, b0 + y0);
+        compare(a0 + x1, a1, b0 + y1, b1);
+    }
+
+public:
+    explicit Differ(Eq equal) : eq(equal), mid(0), work(0) {}
+
+    // Returns the hunks turning a sequence of n elements into one of m, in order
+    std::vector<Hunk> run(std::size_t n, std::size_t m) {
+        hunks.clear();
+        work = WORK_LIMIT;
+        mid = static_cast<long>((n + m + 1) / 2) + 1;
+        fwd.assign(2 * mid + 1, 0);
+        bwd.assign(2 * mid + 1, 0);
+        compare(0, n, 0, m);
+        return hunks;
+    }
+};
+
+// Returns the byte-level hunks turning a into b
+inline std::vector<Hunk> bytes(const std::string& a, const std::string& b) {
+    const char* pa = a.data();
+    const char* pb = b.data();
+    auto eq = [pa, pb](long i, long j) {return pa[i] == pb[j];};
+    return Differ<decltype(eq)>(eq).run(a.size(), b.size());
+}
+
+// Returns the hunks turning a into b compared word by word, in byte offsets
+inline std::vector<Hunk> words(const std::string& a, const std::string& b) {
+    std::vector<Token> ta = tokenize(a), tb = tokenize(b);
+    const Token* xa = ta.data();
+    const Token* xb = tb.data();
+    const char* pa = a.data();
+    const char* pb = b.data();
+    auto eq = [xa, xb, pa, pb](long i, long j) {
+        return xa[i].hash == xb[j].hash && xa[i].length == xb[j].length
+            && std::memcmp(pa + xa[i].offset, pb + xb[j].offset, xa[i].length) == 0;
+    };
+    std::vector<Hunk> hunks = Differ<decltype(eq)>(eq).run(ta.size(), tb.size());
+    for (Hunk& h : hunks) { // Token indices to byte offsets
+        h.a_begin = h.a_begin < ta.size() ? ta[h.a_begin].offset : a.size();
+        h.a_end = h.a_end < ta.size() ? ta[h.a_end].offset : a.size();
+        h.b_begin = h.b_begin < tb.size() ? tb[h.b_begin].offset : b.size();
+        h.b_end = h.b_end < tb.size() ? tb[h.b_end].offset : b.size();
+    }
+    return hunks;
+}
+
+// Conflict is a region both sides changed differently: base[base_begin, base_end) became
+// a[a_begin, a_end) on one side and b[b_begin, b_end) on the other
+struct Conflict {
+    std::size_t base_begin, base_end;
+    std::size_t a_begin, a_end;
+    std::size_t b_begin, b_end;
+};
+
+// MergeResult is the outcome of a three-way merge: the merged text, or the conflicts
+struct MergeResult {
+    std::string text;                // Merged text (empty if there are conflicts)
+    std::vector<Conflict> conflicts;
+};
+
+// Merges the changes that turned base into a and into b, compared word by word (see
+// words()). Both hunk lists are in base offsets, so they are walked together: hunks that
+// overlap or touch form one region, taken from the side that changed it, or from either if
+// both made the same change; otherwise the region conflicts. Unchanged text is copied from
+// base. O(diff(base, a) + diff(base, b) + output).
+inline MergeResult merge3(const std::string& base, const std::string& a, const std::string& b) {
+    MergeResult result;
+    if (a == b || b == base) {result.text = a; return result;}
+    if (a == base) {result.text = b; return result;}
+    std::vector<Hunk> ha = words(base, a), hb = words(base, b);
+    std::size_t ia = 0, ib = 0;
+    std::size_t copied = 0; // Base text before this offset is already handled
+    while (ia < ha.size() || ib < hb.size()) {
+        // Start a region at the earlier hunk, then absorb every hunk overlapping or touching it
+        bool from_a = ib == hb.size() || (ia < ha.size() && ha[ia].a_begin <= hb[ib].a_begin);
+        std::size_t begin = from_a ? ha[ia].a_begin : hb[ib].a_begin, end = begin;
+        std::size_t a0 = ia, b0 = ib;
+        while (true) {
+            if (ia < ha.size() && ha[ia].a_begin <= end) end = std::max(end, ha[ia++].a_end);
+            else if (ib < hb.size() && hb[ib].a_begin <= end) end = std::max(end, hb[ib++].a_end);
+            else break;
+        }
+        // The region as each side has it; text around a side's hunks is unchanged base text
+        std::size_t sa_begin = begin, sa_end = end, sb_begin = begin, sb_end = end;
+        if (ia > a0) {
+            sa_begin = ha[a0].b_begin - (ha[a0].a_begin - begin);
+            sa_end = ha[ia - 1].b_end + (end - ha[ia - 1].a_end);
+        }
+        if (ib > b0) {
+            sb_begin = hb[b0].b_begin - (hb[b0].a_begin - begin);
+            sb_end = hb[ib - 1].b_end + (end - hb[ib - 1].a_end);
+        }
+        result.text.append(base, copied, begin - copied);
+        copied = end;
+        if (ib == b0) result.text.append(a, sa_begin, sa_end - sa_begin);
+        else if (ia == a0) result.text.append(b, sb_begin, sb_end - sb_begin);
+        else if (a.compare(sa_begin, sa_end - sa_begin, b, sb_begin, sb_end - sb_begin) == 0) {
+            result.text.append(a, sa_begin, sa_end - sa_begin); // Both made the same change
+        }
+        else result.conflicts.push_back(Conflict{begin, end, sa_begin, sa_end, sb_begin, sb_end});
+    }
+    result.text.append(base, copied, std::string::npos);
+    if (!result.conflicts.empty()) result.text.clear();
+    return result;
+}
+
+} // namespace diff
+
+#endif // End of include guard
@@ -3,66 +3,224 @@
 #define FILE_HPP
 
 #include "tree.hpp"      // Includes TreeNode definition
+#include "arena.hpp"     // Includes Arena for version node storage
 #include "hashmap.hpp"   // Includes Map definition
-#include <algorithm>     // For std::reverse
-#include <ctime>         // For std::time_t and std::time
+#include "text_index.hpp" // Includes TextIndex for SEARCH
+#include "clock.hpp"     // For Clock::now
+#include "stats.hpp"     // Stats for bytes copied by INSERT and UPDATE
+#include <algorithm>     // For std::reverse, std::upper_bound and std::nth_element
+#include <functional>    // For std::greater
 #include <stdexcept>     // For exception handling
 #include <vector>        // For std::vector
 #include <string>        // For std::string
+#include <utility>       // For std::move and std::pair
+#include <cstddef>       // For std::size_t
+#include <unordered_set> // For counting shared content once
+#include <unordered_map> // For indexing shared pieces once
+#include <queue>         // For std::priority_queue
+#include <mutex>         // For std::mutex
+#include <atomic>        // For numbering incarnations
+#include <cstdint>       // For std::uint64_t
+#include <unistd.h>      // For unlink
+
+// MemoryStats summarizes how much content memory a file's versions use
+struct MemoryStats {
+    int versions;              // Number of live versions in the file
+    std::size_t logical_bytes; // Sum of content lengths over all versions
+    std::size_t stored_bytes;  // Content bytes actually held, counting shared chunks once
+    std::size_t allocated_bytes; // Bytes allocated to hold them: chunk capacity and bookkeeping
+};
+
+// HandlePool hands out small, dense integer handles and reuses released ones
+class HandlePool {
+private:
+    std::mutex lock;               // Guards the pool; files are created and deleted from many threads
+    std::vector<int> free_handles; // Released handles available for reuse
+    int next_handle = 0;           // Next never-used handle
+public:
+    // Returns an unused handle
+    int acquire() {
+        std::lock_guard<std::mutex> guard(lock);
+        if (free_handles.empty()) return next_handle++;
+        int h = free_handles.back();
+        free_handles.pop_back();
+        return h;
+    }
+    // Returns a handle to the pool
+    void release(int h) {
+        std::lock_guard<std::mutex> guard(lock);
+        free_handles.push_back(h);
+    }
+};
+
+// Activation records that a version became the active one at a given time
+struct Activation {
+    Clock::time_point at;
+    int version;              // By ID, so the record outlives a reclaimed version
+};
+
+// RetentionPolicy chooses which snapshotted versions garbage collection keeps. With
+// neither rule set every snapshot is kept; otherwise a snapshot is kept if either rule
+// keeps it. Unsnapshotted versions other than the active one are never kept.
+struct RetentionPolicy {
+    int keep_last = -1;                 // Keep the newest keep_last snapshots (-1: rule off)
+    Clock::time_point keep_newer = -1;  // Keep snapshots taken at most this many microseconds ago (-1: rule off)
+};
+
+// ReclaimStats reports what garbage collection freed
+struct ReclaimStats {
+    int versions = 0;       // Versions removed
+    std::size_t bytes = 0;  // Content and node memory released
+};
+
+// FileMark records what File::Restore needs to undo the INSERT, UPDATE, SNAPSHOT, ROLLBACK
+// and MERGE commands run on a file after File::Mark: its version count, active version and
+// timeline length then, plus the earlier state of every older version that was since
+// changed in place (recorded by File::Touch)
+struct FileMark {
+    int total_versions;
+    int active;
+    Clock::time_point last_modified;
+    std::size_t timeline_size;
+    std::vector<std::pair<int, VersionState>> changed; // (version ID, state before its first change)
+};
+
+class CheckpointIO; // Saves and restores files in checkpoints (storage.hpp)
+class FileHolder;  // Keeps changed files to itself until it ends (file_hash.hpp)
 
 // File class manages versioned content using a tree structure
 class File{
 private:
+    friend class CheckpointIO;
+
     std::string file_name;      // Name of the file
+    Arena<TreeNode> nodes;      // Owns every version node of this file
     TreeNode* root;             // Root version node
     TreeNode* active_version;   // Currently active version node
     Map version_map;            // Maps version IDs to TreeNode pointers
     int total_versions;         // Total number of versions created
-    std::time_t last_modified;  // Timestamp of last modification
+    Clock::time_point last_modified; // Timestamp of last modification
+    int handle;                 // Stable integer handle, unique among live files
+    std::vector<Activation> timeline; // Every change of active version, oldest first (times never decrease)
+    SearchDoc search_doc;       // This file's entry in the search index
+    std::mutex file_mutex;      // Serializes operations on this file (see ShardedFileTable)
+    std::string spill_path;     // File holding the spilled version tree, or empty while it is in memory
+    Clock::time_point last_used = 0; // When a command last looked the file up (tracked while spilling)
+    std::uint64_t incarnation = next_incarnation(); // Tells this File from any other, earlier or later
+    FileHolder* holder = nullptr; // Transaction that changed this file and has not ended, or nullptr
+    bool tombstone = false;     // Deleted by its holder, which keeps the name until it ends
+
+    // Returns a number no File has had yet
+    static std::uint64_t next_incarnation() {
+        static std::atomic<std::uint64_t> counter(0);
+        return ++counter;
+    }
+
+    // Tag for a file that only carries a version tree being read back (see CheckpointIO::load)
+    struct Detached {};
+    // Constructor: creates a root-only file without a handle or search document
+    File(const std::string& name, Detached) : file_name(name), handle(-1) {
+        root = nodes.create(0);
+        version_map.put(0, root);
+        total_versions = 1;
+        active_version = root;
+        last_modified = 0;
+    }
+
+    // Returns the pool that file handles are drawn from
+    static HandlePool& handle_pool() {
+        static HandlePool pool;
+        return pool;
+    }
+    // Makes node the active version and records the change in the timeline
+    void activate(TreeNode* node) {
+        active_version = node;
+        Clock::time_point t = Clock::now();
+        if (!timeline.empty()) {
+            if (timeline.back().version == node -> get_version_id()) return;
+            if (t < timeline.back().at) t = timeline.back().at; // Clock read before this file's lock was taken
+        }
+        timeline.push_back(Activation{t, node -> get_version_id()});
+    }
+    // Rebuilds the timeline from creation times alone, for files restored without one:
+    // each version is taken to be active from its creation until the next one was created
+    void rebuild_timeline() {
+        timeline.clear();
+        Clock::time_point latest = 0;
+        for (int id = 0; id < total_versions; id++) {
+            TreeNode* node = version_map.get(id);
+            if (!node) continue;
+            latest = std::max(latest, node -> get_created_time());
+            timeline.push_back(Activation{latest, id});
+        }
+        int active = active_version -> get_version_id();
+        if (timeline.back().version != active) timeline.push_back(Activation{std::max(latest, last_modified), active});
+    }
+    // Adds text appended to content `before` to the search index
+    void index_append(const Rope& before, const std::string& text) {
+        if (!search_doc.id) return;
+        char tail[2] = {0, 0};
+        std::size_t n = before.copy_tail(tail, 2);
+        TextIndex::instance().add_text(search_doc, tail, n, text.data(), text.size());
+    }
 public:
     // Constructor: creates a new file with initial root version
     File(const std::string& name) { // CREATE
         file_name = name;
-        root = new TreeNode(0); // Create root node with version 0
+        root = nodes.create(0); // Create root node with version 0
         root -> snapshot("This is the root"); // Snapshot root with message
         version_map.put(0, root); // Map version 0 to root node
         total_versions = 1; // Initialize version count
-        active_version = root; // Set active version to root
-        last_modified = std::time(nullptr); // Set last modified timestamp
+        activate(root); // Set active version to root
+        last_modified = Clock::now(); // Set last modified timestamp
+        handle = handle_pool().acquire(); // Take a dense integer handle
+        search_doc.id = TextIndex::instance().add_document(name);
     }
-    // Destructor: deletes the root node (recursively deletes all children)
+    // Destructor: releases the handle and any spill file; the arena then frees every version at once
     ~File() {
-        delete root;
+        TextIndex::instance().remove_document(search_doc);
+        if (!spill_path.empty()) ::unlink(spill_path.c_str()); // Before the handle naming it is reused
+        if (handle >= 0) handle_pool().release(handle);
     }
+    // Disable copying: a handle belongs to exactly one file
+    File(const File&) = delete;
+    File& operator=(const File&) = delete;
     // Returns the content of the active version
-    const std::string& Read() const { // READ
-        return active_version -> get_content();
+    std::string Read() const { // READ
+        return active_version -> get_content().str();
     }
     // Inserts content to the active version; creates new version if snapshotted
     void Insert(const std::string& content) { // INSERT
+        Stats::copied(Stats::COPY_INSERT, content.size());
         if (active_version -> is_snapshot()) {
-            TreeNode* child = new TreeNode(total_versions, active_version -> get_content() + content, active_version);
-            active_version = child;
+            Rope extended = active_version -> get_content();
+            index_append(extended, content);
+            extended.append(content);
+            TreeNode* child = nodes.create(total_versions, std::move(extended), active_version);
+            activate(child);
             version_map.put(total_versions, child);
             total_versions++;
         }
         else {
-            active_version -> update_content(active_version -> get_content() + content);
+            index_append(active_version -> get_content(), content); // The copy is gone before the append
+            active_version -> append_content(content); // Amortized O(appended bytes)
         }
-        last_modified = std::time(nullptr);
+        last_modified = Clock::now();
     }
     // Updates the content of the active version; creates new version if snapshotted
     void Update(const std::string& content) { // UPDATE
+        Stats::copied(Stats::COPY_UPDATE, content.size());
+        index_append(Rope(), content);
         if (active_version -> is_snapshot()) {
-            TreeNode* child = new TreeNode(total_versions, content, active_version);
-            active_version = child;
+            TreeNode* child = nodes.create(total_versions, Rope(content), active_version);
+            activate(child);
             version_map.put(total_versions, child);
             total_versions++;
         }
         else {
             active_version -> update_content(content);
         }
-        last_modified = std::time(nullptr);
+        last_modified = Clock::now();
     }
     // Snapshots the active version with a message
     void Snapshot(const std::string& message = "This version has been snapshotted") {
@@ -75,37 +233,380 @@ public:
             if (!parent) {
                 throw std::invalid_argument("Already at root; cannot rollback to parent");
             }
-            active_version = parent;
+            activate(parent);
         }
         else {
             TreeNode* target = version_map.get(versionID);
             if (!target) {
                 throw std::invalid_argument("Supplied version ID does not exist");
             }
-            active_version = target;
+            activate(target);
         }
     }
-    // Returns a vector of all snapshotted versions from root to active
-    std::vector<TreeNode*> History() const {
+    // Returns the number of snapshotted versions from root to active
+    int History_Size() const {
+        return active_version -> get_snapshot_depth() + (active_version -> is_snapshot() ? 1 : 0);
+    }
+    // Returns snapshotted versions from root to active, oldest first. With a limit, returns only
+    // the newest `limit` entries after skipping the newest `offset`. Follows snapshot-ancestor
+    // links, so the cost is O(offset + entries returned) regardless of tree depth.
+    std::vector<TreeNode*> History(int limit = -1, int offset = 0) const {
         std::vector<TreeNode*> result;
-        TreeNode* cur = active_version;
+        TreeNode* cur = active_version -> is_snapshot() ? active_version : active_version -> get_snapshot_parent();
+        for (int i = 0; i < offset && cur; i++) {
+            cur = cur -> get_snapshot_parent();
+        }
+        while (cur && (limit < 0 || static_cast<int>(result.size()) < limit)) {
+            result.push_back(cur);
+            cur = cur -> get_snapshot_parent();
+        }
 
-        while (cur) {
-            if (cur -> is_snapshot()) {
-                result.push_back(cur);
+        std::reverse(result.begin(), result.end());
+        return result;
+    }
+    // Returns the ID of the version that was active at time t, or -1 if the file did not
+    // exist yet. The version may since have been reclaimed. O(log n) over the n changes of
+    // active version.
+    int Version_At(Clock::time_point t) const {
+        auto it = std::upper_bound(timeline.begin(), timeline.end(), t,
+                                   [](Clock::time_point v, const Activation& a) {return v < a.at;});
+        return it == timeline.begin() ? -1 : (it - 1) -> version;
+    }
+    // Returns the time the file was created
+    Clock::time_point get_created_time() const {
+        return timeline.front().at;
+    }
+    // Adds the content of every version to the search index (for files restored from a checkpoint)
+    void Index_Versions() {
+        if (!search_doc.id) return;
+        std::unordered_map<const char*, std::size_t> seen;
+        for (int id = 0; id < total_versions; id++) {
+            TreeNode* node = version_map.get(id);
+            if (node) TextIndex::instance().add_rope(search_doc, node -> get_content(), seen);
+        }
+    }
+    // Returns the states a clone of the given version starts from, oldest first. With
+    // history, these are the snapshotted versions from the root to it (as HISTORY lists
+    // them) followed by the version itself if it is not snapshotted; otherwise just the
+    // version, as a snapshot taken now. Contents are shared. Throws if the version is missing.
+    std::vector<VersionState> Version_Chain(int versionID, bool history) const {
+        TreeNode* node = version_map.get(versionID);
+        if (!node) {
+            throw std::invalid_argument("Supplied version ID does not exist");
+        }
+        std::vector<VersionState> chain;
+        if (!history) {
+            VersionState s = node -> state();
+            s.created = s.snapshotted = Clock::now();
+            s.message = "Cloned from '" + file_name + "' version " + std::to_string(versionID);
+            chain.push_back(std::move(s));
+            return chain;
+        }
+        if (!node -> is_snapshot()) chain.push_back(node -> state());
+        for (TreeNode* cur = node -> is_snapshot() ? node : node -> get_snapshot_parent(); cur; cur = cur -> get_snapshot_parent()) {
+            chain.push_back(cur -> state());
+        }
+        std::reverse(chain.begin(), chain.end());
+        return chain;
+    }
+    // Replaces the versions of a newly created file with the given states, oldest first:
+    // the first becomes the root, each later one a child of the one before, and the last
+    // is made active. Contents are shared with wherever the states came from. Every state
+    // but the last must be snapshotted. O(number of states).
+    void Clone_From(const std::vector<VersionState>& chain) {
+        if (total_versions != 1 || chain.empty()) throw std::logic_error("Only a new file can be cloned into");
+        for (std::size_t i = 0; i + 1 < chain.size(); i++) {
+            if (!chain[i].snapshotted) throw std::invalid_argument("Only the newest cloned version may be unsnapshotted");
+        }
+        if (!chain[0].snapshotted) throw std::invalid_argument("The cloned root must be snapshotted");
+        root -> set_state(chain[0]);
+        TreeNode* cur = root;
+        for (std::size_t i = 1; i < chain.size(); i++) {
+            TreeNode* child = nodes.create(total_versions, Rope(), cur);
+            child -> set_state(chain[i]);
+            version_map.put(total_versions, child);
+            total_versions++;
+            cur = child;
+        }
+        active_version = cur;
+        timeline.clear();
+        activate(cur);
+        last_modified = Clock::now();
+    }
+    // Returns the nearest common ancestor of two versions; throws if either is missing.
+    // Without merges among their ancestors this is the lowest common ancestor, in
+    // O(log depth). Otherwise ancestors are also reached through second parents, and the
+    // common one with the largest ID is returned (no other common ancestor descends from
+    // it): both versions are walked back in decreasing ID order, since every version has a
+    // larger ID than its parents, down to the first-parent common ancestor at the latest.
+    TreeNode* Common_Ancestor(int v1, int v2) const {
+        TreeNode* a = version_map.get(v1);
+        TreeNode* b = version_map.get(v2);
+        if (!a || !b) {
+            throw std::invalid_argument("Supplied version ID does not exist");
+        }
+        TreeNode* lca = const_cast<TreeNode*>(TreeNode::common_ancestor(a, b));
+        if (!a -> has_merged_ancestry() && !b -> has_merged_ancestry()) return lca;
+        int floor = lca -> get_version_id(); // Older versions cannot be nearer
+        std::vector<char> reached(total_versions, 0); // Bit 1: an ancestor of v1, bit 2: of v2
+        std::priority_queue<int> pending;             // Reached IDs, largest first
+        auto reach = [&](const TreeNode* n, char side) {
+            int id = n -> get_version_id();
+            if (id < floor) return;
+            if (!reached[id]) pending.push(id);
+            reached[id] |= side;
+        };
+        reach(a, 1);
+        reach(b, 2);
+        while (!pending.empty()) {
+            int id = pending.top();
+            pending.pop();
+            if (reached[id] == 3) return version_map.get(id); // Every descendant was already popped
+            TreeNode* n = version_map.get(id);
+            if (n -> get_parent()) reach(n -> get_parent(), reached[id]);
+            if (n -> get_merge_parent()) reach(n -> get_merge_parent(), reached[id]);
+        }
+        return lca;
+    }
+    // Creates a merge of versions v1 and v2 holding the given content: a new version with
+    // v1 as its parent and v2 as its second parent, made active. Like a version made by
+    // INSERT or UPDATE it is not snapshotted yet, so it can be edited before SNAPSHOT.
+    // Both versions must be snapshotted (and so never change). Returns the new version.
+    TreeNode* Merge(int v1, int v2, const std::string& content) { // MERGE
+        TreeNode* first = version_map.get(v1);
+        TreeNode* second = version_map.get(v2);
+        if (!first || !second) {
+            throw std::invalid_argument("Supplied version ID does not exist");
+        }
+        if (first == second) {
+            throw std::invalid_argument("A version cannot be merged into itself");
+        }
+        if (!first -> is_snapshot() || !second -> is_snapshot()) {
+            throw std::invalid_argument("Only snapshotted versions can be merged");
+        }
+        index_append(Rope(), content);
+        TreeNode* node = nodes.create(total_versions, Rope(content), first);
+        node -> set_merge_parent(second);
+        activate(node);
+        version_map.put(total_versions, node);
+        total_versions++;
+        last_modified = Clock::now();
+        return node;
+    }
+    // Returns the IDs of the versions the policy lets go, in increasing order. The root, the
+    // active version and every ancestor of a kept version (through either parent) are kept
+    // too, so the tree stays connected and HISTORY, DIFF and ROLLBACK keep working on every
+    // survivor.
+    std::vector<int> Unretained(const RetentionPolicy& policy) const {
+        std::vector<char> keep(total_versions, 0);
+        std::vector<std::pair<Clock::time_point, int>> snapshots; // (snapshot time, ID)
+        for (int id = 0; id < total_versions; id++) {
+            TreeNode* node = version_map.get(id);
+            if (node && node -> is_snapshot()) snapshots.emplace_back(node -> get_snapshot_time(), id);
+        }
+        bool keep_all = policy.keep_last < 0 && policy.keep_newer < 0;
+        if (policy.keep_last > 0 && static_cast<std::size_t>(policy.keep_last) < snapshots.size()) { // Newest first
+            std::nth_element(snapshots.begin(), snapshots.begin() + policy.keep_last, snapshots.end(),
+                             std::greater<std::pair<Clock::time_point, int>>());
+        }
+        Clock::time_point cutoff = policy.keep_newer >= 0 ? Clock::now() - policy.keep_newer : 0;
+        for (std::size_t i = 0; i < snapshots.size(); i++) {
+            if (keep_all || (policy.keep_last >= 0 && i < static_cast<std::size_t>(policy.keep_last))
+                || (policy.keep_newer >= 0 && snapshots[i].first >= cutoff)) {
+                keep[snapshots[i].second] = 1;
             }
-            cur = cur -> get_parent();
         }
+        keep[0] = 1;
+        keep[active_version -> get_version_id()] = 1;
+        std::vector<int> dropped;
+        for (int id = total_versions - 1; id > 0; id--) { // Children have larger IDs than their parents
+            TreeNode* node = version_map.get(id);
+            if (!node) continue;
+            if (!keep[id]) {
+                dropped.push_back(id);
+                continue;
+            }
+            keep[node -> get_parent() -> get_version_id()] = 1;
+            if (node -> get_merge_parent()) keep[node -> get_merge_parent() -> get_version_id()] = 1;
+        }
+        std::reverse(dropped.begin(), dropped.end());
+        return dropped;
+    }
+    // Removes the given versions and compacts the survivors into a fresh arena, keeping
+    // their IDs. Throws if a version is missing, is the root or the active version, or has
+    // a child (or a merge it is the second parent of) that is not removed too.
+    // O(number of versions).
+    ReclaimStats Remove_Versions(const std::vector<int>& ids) {
+        std::vector<char> drop(total_versions, 0);
+        for (int id : ids) {
+            TreeNode* node = version_map.get(id);
+            if (!node || id == 0 || node == active_version) {
+                throw std::invalid_argument("Version " + std::to_string(id) + " cannot be removed");
+            }
+            drop[id] = 1;
+        }
+        for (int id : ids) {
+            for (TreeNode* c = version_map.get(id) -> get_first_child(); c; c = c -> get_next_sibling()) {
+                if (!drop[c -> get_version_id()]) {
+                    throw std::invalid_argument("Version " + std::to_string(id) + " has a surviving child");
+                }
+            }
+        }
+        for (int id = 0; id < total_versions; id++) {
+            TreeNode* node = version_map.get(id);
+            TreeNode* second = node ? node -> get_merge_parent() : nullptr;
+            if (second && !drop[id] && drop[second -> get_version_id()]) {
+                throw std::invalid_argument("Version " + std::to_string(second -> get_version_id()) + " has a surviving merge");
+            }
+        }
+        ReclaimStats result;
+        if (ids.empty()) return result;
+        std::size_t before = Memory_Usage().allocated_bytes + nodes.capacity_bytes();
 
-        std::reverse(result.begin(), result.end());
+        // Rebuild in ID order, so every parent exists before its children and each child
+        // list keeps its newest-first order; depths and jump pointers come out unchanged
+        Arena<TreeNode> fresh;
+        Map fresh_map;
+        for (int id = 0; id < total_versions; id++) {
+            TreeNode* old = version_map.get(id);
+            if (!old || drop[id]) continue;
+            TreeNode* parent = old -> get_parent() ? fresh_map.get(old -> get_parent() -> get_version_id()) : nullptr;
+            TreeNode* node = fresh.create(id, Rope(), parent);
+            if (old -> get_merge_parent()) node -> set_merge_parent(fresh_map.get(old -> get_merge_parent() -> get_version_id()));
+            node -> take_state(*old);
+            fresh_map.put(id, node);
+        }
+        root = fresh_map.get(0);
+        active_version = fresh_map.get(active_version -> get_version_id());
+        version_map = std::move(fresh_map);
+        nodes.swap(fresh); // The old nodes and their slabs are freed with `fresh` on return
+
+        result.versions = ids.size();
+        std::size_t after = Memory_Usage().allocated_bytes + nodes.capacity_bytes();
+        result.bytes = before > after ? before - after : 0;
         return result;
     }
+    // Returns a mark that Restore can later return the file to
+    FileMark Mark() const {
+        return FileMark{total_versions, active_version -> get_version_id(), last_modified, timeline.size(), {}};
+    }
+    // Records the active version's state in the mark before INSERT, UPDATE or SNAPSHOT may
+    // change it in place, unless it is snapshotted (and so never changes), newer than the
+    // mark or already recorded
+    void Touch(FileMark& mark) const {
+        int id = active_version -> get_version_id();
+        if (active_version -> is_snapshot() || id >= mark.total_versions) return;
+        for (const auto& c : mark.changed) {
+            if (c.first == id) return;
+        }
+        mark.changed.emplace_back(id, active_version -> state());
+    }
+    // Returns the file to a mark: versions created since are removed (their IDs are handed
+    // out again), changed versions get their recorded state back, and the active version,
+    // timeline and modification time are reset. Versions must not have been removed since.
+    // O(number of versions) when versions were created, otherwise O(changed versions).
+    void Restore(const FileMark& mark) {
+        active_version = version_map.get(mark.active);
+        for (auto it = mark.changed.rbegin(); it != mark.changed.rend(); ++it) {
+            version_map.get(it -> first) -> set_state(it -> second);
+        }
+        std::vector<int> added;
+        for (int id = mark.total_versions; id < total_versions; id++) added.push_back(id);
+        Remove_Versions(added); // Rebuilt after the states above, so snapshot links follow them
+        total_versions = mark.total_versions;
+        timeline.resize(mark.timeline_size);
+        last_modified = mark.last_modified;
+    }
+    // Frees the version tree once it has been written to path (see Spiller). The name,
+    // handle, counts and timestamps stay, so lookups and the rankings work without it;
+    // everything else must wait for Unspill.
+    void Spill(const std::string& path) {
+        Arena<TreeNode> freed;
+        nodes.swap(freed); // The nodes and their slabs are freed with `freed` on return
+        version_map = Map();
+        root = active_version = nullptr;
+        std::vector<Activation>().swap(timeline);
+        spill_path = path;
+    }
+    // Takes back the version tree from a detached copy read from the spill file, which is
+    // then deleted (contents read from it stay mapped until they are replaced)
+    void Unspill(File& loaded) {
+        nodes.swap(loaded.nodes);
+        std::swap(version_map, loaded.version_map);
+        std::swap(root, loaded.root);
+        std::swap(active_version, loaded.active_version);
+        timeline.swap(loaded.timeline);
+        ::unlink(spill_path.c_str());
+        spill_path.clear();
+    }
+    // Returns true while the version tree is on disk
+    bool Is_Spilled() const {
+        return !spill_path.empty();
+    }
+    // Returns the spill file, or an empty string while the version tree is in memory
+    const std::string& get_spill_path() const {
+        return spill_path;
+    }
+    // Records that a command is using the file
+    void Use() {
+        last_used = Clock::now();
+    }
+    // Returns when a command last used the file (0 if not tracked)
+    Clock::time_point get_last_used() const {
+        return last_used;
+    }
+    // Computes logical vs. stored (and allocated) content bytes across all versions
+    MemoryStats Memory_Usage() const {
+        MemoryStats stats{0, 0, 0, 0};
+        std::unordered_set<const void*> seen;
+        for (int id = 0; id < total_versions; id++) {
+            TreeNode* node = version_map.get(id);
+            if (!node) continue;
+            stats.versions++;
+            stats.logical_bytes += node -> content_size();
+            node -> account(seen, stats.stored_bytes, stats.allocated_bytes);
+        }
+        return stats;
+    }
     // Returns the file name
     const std::string& get_filename() const {
         return file_name;
     }
+    // Returns the file's integer handle, stable for its lifetime
+    int get_handle() const {
+        return handle;
+    }
+    // Returns the file's search index document id (0 if not indexed)
+    std::uint32_t get_search_id() const {
+        return search_doc.id;
+    }
+    // Returns the number that identifies this File for its lifetime; a file deleted and
+    // created again under the same name (even at the same address) gets a new one
+    std::uint64_t get_incarnation() const {
+        return incarnation;
+    }
+    // Returns the transaction holding this file, or nullptr; the caller holds the file's lock
+    FileHolder* get_holder() const {
+        return holder;
+    }
+    // Sets or clears the holder; the caller holds the file's lock
+    void set_holder(FileHolder* h) {
+        holder = h;
+    }
+    // Returns true if the holder deleted this file; the caller holds the file's lock
+    bool is_tombstone() const {
+        return tombstone;
+    }
+    // Marks or unmarks the file as deleted by its holder; the caller holds the file's lock
+    void set_tombstone(bool deleted) {
+        tombstone = deleted;
+    }
+    // Returns the mutex guarding this file's version tree
+    std::mutex& mutex() {
+        return file_mutex;
+    }
     // Returns the last modified timestamp
-    std::time_t get_last_modified() const {
+    Clock::time_point get_last_modified() const {
         return last_modified;
     }
     // Returns the total number of versions
@@ -116,6 +617,10 @@ public:
     TreeNode* get_active_version() const {
         return active_version;
     }
+    // Returns the version with the given ID, or nullptr if there is none
+    TreeNode* get_version(int id) const {
+        return version_map.get(id);
+    }
 
 };
 
@@ -2,54 +2,419 @@
 #define FILE_HASH_HPP
 
 #include "file.hpp"      // Includes File class definition
+#include "stats.hpp"     // Stats for probe lengths
 #include <vector>        // For std::vector
 #include <string>        // For std::string
+#include <cstdint>       // For std::uint64_t
+#include <cstddef>       // For std::size_t
 #include <stdexcept>     // For exception handling
+#include <mutex>         // For std::mutex
+#include <condition_variable> // For waiting until held files are released
+#include <atomic>        // For the total file count
+#include <memory>        // For std::unique_ptr
+#include <unordered_map> // For the holders waiting for one another
 
-// FileHash class provides a hash table mapping file names to File pointers
+// FileHash class provides an open-addressing hash table mapping file names to File pointers.
+// Slots hold the precomputed hash next to the File*, so a probe only compares names when
+// the full 64-bit hashes match. The table doubles once it is more than 70% full and uses
+// backward-shift deletion, so there are no tombstones.
 class FileHash {
 private:
-    std::vector<std::vector<std::pair<std::string, File*>>> buckets; // Buckets for hash table, each bucket is a vector of (key, File*) pairs
-    int bucket_count;    // Number of buckets in the hash table
-    int n_entries;       // Total number of entries in the hash table
+    // Slot of the table; file is nullptr when the slot is empty
+    struct Slot {
+        std::uint64_t hash; // Full hash of the file name
+        File* file;         // File stored in this slot (keyed by its own file name)
+    };
+
+    std::vector<Slot> slots; // Table storage; size is always a power of two
+    std::size_t mask;        // slots.size() - 1, used to wrap probe indices
+    std::size_t n_entries;   // Total number of entries in the hash table
 
     static constexpr unsigned long long P = 131; // Prime base for string hashing
+    static constexpr std::size_t MAX_LOAD_NUM = 7;  // Grow when entries exceed 7/10 of the slots
+    static constexpr std::size_t MAX_LOAD_DEN = 10;
 
-    // Hashes a string key to an integer bucket index
-    int hash_str(const std::string& key) const {
-        unsigned long long hash_value = 0;
+    // Hashes a string key to a 64-bit value
+    static std::uint64_t hash_str(const std::string& key) {
+        std::uint64_t hash_value = 0;
         for (char c : key) {
-            hash_value = hash_value * P + c; // Polynomial rolling hash
+            hash_value = hash_value * P + static_cast<unsigned char>(c); // Polynomial rolling hash
+        }
+        // Final avalanche (splitmix64) so the low bits used for indexing depend on every character
+        hash_value ^= hash_value >> 30; hash_value *= 0xbf58476d1ce4e5b9ULL;
+        hash_value ^= hash_value >> 27; hash_value *= 0x94d049bb133111ebULL;
+        hash_value ^= hash_value >> 31;
+        return hash_value;
+    }
+
+    // Returns the slot index holding key, or the empty slot where it would go
+    std::size_t find_slot(const std::string& key, std::uint64_t h) const {
+        std::size_t i = h & mask;
+        std::size_t probes = 0;
+        while (slots[i].file) {
+            if (slots[i].hash == h && slots[i].file -> get_filename() == key) break;
+            i = (i + 1) & mask; // Linear probing
+            probes++;
+        }
+        Stats::probed(probes);
+        return i;
+    }
+
+    // Doubles the table and reinserts every entry
+    void grow() {
+        std::vector<Slot> old;
+        old.swap(slots);
+        slots.assign(old.size() * 2, Slot{0, nullptr});
+        mask = slots.size() - 1;
+        for (const Slot& s : old) {
+            if (!s.file) continue;
+            std::size_t i = s.hash & mask;
+            while (slots[i].file) i = (i + 1) & mask;
+            slots[i] = s;
         }
-        return hash_value % bucket_count; // Map hash value to bucket index
     }
 
 public:
-    // Constructor: initializes hash table with given number of buckets (default 1009)
-    FileHash(int b = 1009) {
-        bucket_count = b;
+    // Constructor: initializes hash table with room for at least the given number of slots (default 1024)
+    FileHash(std::size_t capacity = 1024) {
+        std::size_t cap = 16;
+        while (cap < capacity) cap *= 2; // Round up to a power of two
+        slots.assign(cap, Slot{0, nullptr});
+        mask = cap - 1;
         n_entries = 0;
-        buckets.resize(bucket_count); // Resize buckets vector
     }
-    // Inserts a (key, File*) pair into the hash table
-    void put(const std::string& key, File* file) {
-        int idx = hash_str(key); // Compute bucket index
-        buckets[idx].emplace_back(key, file); // Add pair to bucket
-        n_entries++;
+    // Inserts a File* into the hash table, keyed by its file name
+    void put(File* file) {
+        if (!file) throw std::invalid_argument("file is null");
+        if ((n_entries + 1) * MAX_LOAD_DEN > slots.size() * MAX_LOAD_NUM) grow();
+        std::uint64_t h = hash_str(file -> get_filename());
+        std::size_t i = find_slot(file -> get_filename(), h);
+        if (!slots[i].file) n_entries++;
+        slots[i] = Slot{h, file}; // Replaces an existing entry with the same name
     }
     // Retrieves the File* associated with the given key, or nullptr if not found
     File* get(const std::string& key) const {
-        int idx = hash_str(key); // Compute bucket index
-        for (const auto& pr : buckets[idx]) {
-            if (pr.first == key) return pr.second; // Return File* if key matches
-        }
-        return nullptr; // Not found
+        return slots[find_slot(key, hash_str(key))].file;
     }
     // Checks if a key exists in the hash table
     bool exists(const std::string& key) const {
         return get(key) != nullptr;
     }
+    // Removes the entry for key and returns its File*, or nullptr if not found
+    File* remove(const std::string& key) {
+        std::size_t i = find_slot(key, hash_str(key));
+        File* removed = slots[i].file;
+        if (!removed) return nullptr;
+        // Backward-shift deletion: pull later entries of the probe run into the hole
+        std::size_t hole = i;
+        std::size_t j = i;
+        while (true) {
+            j = (j + 1) & mask;
+            if (!slots[j].file) break;
+            std::size_t home = slots[j].hash & mask;
+            // Entry j may move into the hole only if its home is not cyclically in (hole, j]
+            if (((j - home) & mask) >= ((j - hole) & mask)) {
+                slots[hole] = slots[j];
+                hole = j;
+            }
+        }
+        slots[hole] = Slot{0, nullptr};
+        n_entries--;
+        return removed;
+    }
+    // Calls fn on every stored File*, in no particular order
+    template <typename Fn>
+    void for_each(Fn fn) const {
+        for (const Slot& s : slots) {
+            if (s.file) fn(s.file);
+        }
+    }
+    // Returns the number of files in the table
+    std::size_t size() const {
+        return n_entries;
+    }
+
+};
+
+// FileHolder keeps the files it changes to itself until it ends: an open transaction (see
+// transaction.hpp). Each thread acts for at most one holder at a time, its current one.
+class FileHolder {
+protected:
+    // Returns the current holder slot of the calling thread
+    static FileHolder*& slot() {
+        static thread_local FileHolder* h = nullptr;
+        return h;
+    }
+
+public:
+    // Returns the holder the calling thread acts for, or nullptr
+    static FileHolder* current() {return slot();}
+};
+
+// ShardedFileTable splits the file table into independently locked FileHash shards so that
+// commands on different files can run in parallel. Files are handed out with their own
+// mutex locked, using lock coupling: the shard lock is held until the file lock is taken.
+// A file can therefore only be deleted by a thread holding both its shard lock and its
+// file lock, and a pointer obtained through acquire() stays valid until it is unlocked.
+// Lock order: shard -> file -> release_lock.
+// With a loader set (see Spiller), acquire() hands each file to it once the shard lock is
+// released, so spilled files are read back before the caller sees them.
+// A file held by a FileHolder other than the caller's current one is not handed out:
+// acquire(), create() and remove() unlock it, wait until some holder releases its files and
+// look the name up again, since the file may be gone by then. A holder waiting, directly or
+// through others, for a file held by the caller's holder would never be released, so the
+// caller gets an error instead. Background work passes skip_held and moves on.
+class ShardedFileTable {
+public:
+    typedef void (*Loader)(File* f); // Prepares a locked file for use
+
+private:
+    // One independently locked part of the table
+    struct Shard {
+        std::mutex lock;
+        FileHash table;
+    };
+
+    std::vector<std::unique_ptr<Shard>> shards; // Fixed set of shards
+    std::atomic<std::size_t> n_files;           // Total number of files across shards
+    Loader loader = nullptr;                    // Set before commands run, or never
+
+    std::mutex release_lock;                    // Guards releases and waits_for
+    std::condition_variable released;           // Signalled when a holder releases its files
+    std::uint64_t releases = 0;                 // Number of releases so far
+    std::unordered_map<const FileHolder*, const FileHolder*> waits_for; // Holder each waiting holder waits for
+
+    // Returns the shard responsible for key
+    Shard& shard_for(const std::string& key) {
+        std::size_t h = 0;
+        for (char c : key) h = h * 31 + static_cast<unsigned char>(c);
+        return *shards[(h ^ (h >> 16)) % shards.size()];
+    }
+
+    // Returns true if f, locked by the caller, is held by a holder other than the caller's
+    static bool held_by_other(File* f) {
+        return f -> get_holder() && f -> get_holder() != FileHolder::current();
+    }
+
+    // Unlocks f, which held_by_other, and waits for the next release. Throws instead if
+    // f's holder waits, directly or not, for the caller's holder.
+    void wait_for_release(File* f) {
+        std::unique_lock<std::mutex> guard(release_lock);
+        const FileHolder* self = FileHolder::current();
+        if (self) {
+            for (const FileHolder* h = f -> get_holder(); h;) {
+                if (h == self) {
+                    std::string name = f -> get_filename();
+                    f -> mutex().unlock();
+                    throw std::runtime_error("Deadlock: file '" + name + "' is held by a transaction waiting for this one");
+                }
+                auto it = waits_for.find(h);
+                h = it == waits_for.end() ? nullptr : it -> second;
+            }
+            waits_for[self] = f -> get_holder();
+        }
+        std::uint64_t seen = releases; // Read before f is unlocked: its holder cannot release it before
+        f -> mutex().unlock();
+        released.wait(guard, [&] {return releases != seen;});
+        if (self) waits_for.erase(self);
+    }
+
+public:
+    // Constructor: creates the given number of shards (default 64)
+    explicit ShardedFileTable(std::size_t n_shards = 64) : n_files(0) {
+        if (n_shards == 0) throw std::invalid_argument("Need at least one shard");
+        for (std::size_t i = 0; i < n_shards; i++) shards.emplace_back(new Shard());
+    }
+
+    // Sets the loader; call before any command runs
+    void set_loader(Loader l) {
+        loader = l;
+    }
+
+    // Returns the file for key with its mutex locked, or nullptr if not found. The file has
+    // been through the loader unless load is false; then a spilled file stays spilled, and
+    // only its name, counts and timestamps may be used. A file held by another holder is
+    // waited for, or treated as not found with skip_held; one deleted by the caller's holder
+    // is not found.
+    // The caller must unlock f->mutex() when done (see LockedFile).
+    File* acquire(const std::string& key, bool load = true, bool skip_held = false) {
+        Shard& sh = shard_for(key);
+        File* f;
+        for (;;) {
+            {
+                std::lock_guard<std::mutex> guard(sh.lock);
+                f = sh.table.get(key);
+                if (!f) return nullptr;
+                f -> mutex().lock();
+            }
+            if (!held_by_other(f)) break;
+            if (skip_held) {
+                f -> mutex().unlock();
+                return nullptr;
+            }
+            wait_for_release(f);
+        }
+        if (f -> is_tombstone()) {
+            f -> mutex().unlock();
+            return nullptr;
+        }
+        if (load && loader) {
+            try {
+                loader(f); // Outside the shard lock: it may read from disk
+            } catch (...) {
+                f -> mutex().unlock();
+                throw;
+            }
+        }
+        return f;
+    }
+
+    // Creates and inserts a file unless the name is taken; on_created(f) runs under the
+    // shard lock so that registration elsewhere is ordered with a later DELETE. A file the
+    // caller's holder deleted is replaced (the holder still owns it).
+    // Returns false if a file with that name already exists.
+    template <typename OnCreated>
+    bool create(const std::string& key, OnCreated on_created) {
+        Shard& sh = shard_for(key);
+        for (;;) {
+            std::unique_lock<std::mutex> guard(sh.lock);
+            File* old = sh.table.get(key);
+            if (old) {
+                std::unique_lock<std::mutex> old_guard(old -> mutex());
+                if (held_by_other(old)) {
+                    guard.unlock();
+                    old_guard.release();
+                    wait_for_release(old);
+                    continue;
+                }
+                if (!old -> is_tombstone()) return false;
+                sh.table.remove(key);
+                n_files--;
+            }
+            File* f = new File(key);
+            sh.table.put(f);
+            n_files++;
+            on_created(f);
+            return true;
+        }
+    }
+
+    // Inserts an existing file (used during recovery, before any other thread runs, and
+    // to put back a file whose deletion is rolled back)
+    void put(File* f) {
+        Shard& sh = shard_for(f -> get_filename());
+        std::lock_guard<std::mutex> guard(sh.lock);
+        if (!sh.table.exists(f -> get_filename())) n_files++;
+        sh.table.put(f);
+    }
+
+    // Returns true if the table maps f's name to f
+    bool contains(File* f) {
+        Shard& sh = shard_for(f -> get_filename());
+        std::lock_guard<std::mutex> guard(sh.lock);
+        return sh.table.get(f -> get_filename()) == f;
+    }
+
+    // Removes the file for key and returns it with its mutex locked, or nullptr if not found.
+    // on_removed(f) runs under the shard lock so that it is ordered with a later CREATE.
+    // With keep_for, the file instead stays in the table as a tombstone held by keep_for,
+    // so that nobody else takes the name until that holder ends.
+    template <typename OnRemoved>
+    File* remove(const std::string& key, OnRemoved on_removed, FileHolder* keep_for = nullptr) {
+        Shard& sh = shard_for(key);
+        for (;;) {
+            std::unique_lock<std::mutex> guard(sh.lock);
+            File* f = sh.table.get(key);
+            if (!f) return nullptr;
+            f -> mutex().lock(); // Waits for the current user of the file, if any
+            if (held_by_other(f)) {
+                guard.unlock();
+                wait_for_release(f);
+                continue;
+            }
+            if (f -> is_tombstone()) {
+                f -> mutex().unlock();
+                return nullptr;
+            }
+            if (keep_for) {
+                f -> set_holder(keep_for);
+                f -> set_tombstone(true);
+            }
+            else {
+                sh.table.remove(key);
+                n_files--;
+            }
+            on_removed(f);
+            return f;
+        }
+    }
+
+    // Removes f, a tombstone, if the table still maps its name to it
+    void drop(File* f) {
+        Shard& sh = shard_for(f -> get_filename());
+        std::lock_guard<std::mutex> guard(sh.lock);
+        if (sh.table.get(f -> get_filename()) != f) return;
+        sh.table.remove(f -> get_filename());
+        n_files--;
+    }
+
+    // Wakes every thread waiting for a held file; call once holder has cleared itself from
+    // the files it held, before it goes away
+    void notify_released(const FileHolder* holder) {
+        {
+            std::lock_guard<std::mutex> guard(release_lock);
+            releases++;
+            for (auto it = waits_for.begin(); it != waits_for.end();) { // Nobody waits for holder any more
+                if (it -> second == holder) it = waits_for.erase(it);
+                else ++it;
+            }
+        }
+        released.notify_all();
+    }
+
+    // Returns true if a file with that name exists
+    bool exists(const std::string& key) {
+        Shard& sh = shard_for(key);
+        std::lock_guard<std::mutex> guard(sh.lock);
+        return sh.table.exists(key);
+    }
+
+    // Returns the names of all files, one shard at a time (not an atomic snapshot)
+    std::vector<std::string> keys() {
+        std::vector<std::string> out;
+        for (auto& sh : shards) {
+            std::lock_guard<std::mutex> guard(sh -> lock);
+            sh -> table.for_each([&](const File* f) {out.push_back(f -> get_filename());});
+        }
+        return out;
+    }
+
+    // Calls fn on every file; the caller must ensure no other thread is using the table
+    template <typename Fn>
+    void for_each(Fn fn) const {
+        for (const auto& sh : shards) sh -> table.for_each(fn);
+    }
+
+    // Returns the number of files in the table
+    std::size_t size() const {
+        return n_files.load();
+    }
+};
+
+// LockedFile looks up a file through ShardedFileTable::acquire and unlocks it on destruction
+class LockedFile {
+private:
+    File* f;
+public:
+    LockedFile(ShardedFileTable& table, const std::string& key, bool load = true, bool skip_held = false)
+        : f(table.acquire(key, load, skip_held)) {}
+    ~LockedFile() {if (f) f -> mutex().unlock();}
+    LockedFile(const LockedFile&) = delete;
+    LockedFile& operator=(const LockedFile&) = delete;
 
+    explicit operator bool() const {return f != nullptr;}
+    File* get() const {return f;}
+    File* operator->() const {return f;}
 };
 
 #endif // End of include guard
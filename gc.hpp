@@ -0,0 +1,109 @@
+// gc.hpp
+#ifndef GC_HPP // Prevents multiple inclusion of this header file
+#define GC_HPP
+
+#include "file_hash.hpp"     // ShardedFileTable and LockedFile
+#include "rwlock.hpp"        // RwLock and SharedLock
+#include "periodic.hpp"      // PeriodicWorker
+#include <string>            // For std::string
+#include <vector>            // For std::vector
+#include <atomic>            // For the counters
+#include <chrono>            // For the sweep interval
+#include <cstdint>           // For std::uint64_t
+#include <cstddef>           // For std::size_t
+
+// CollectorStats reports what garbage collection has done since startup
+struct CollectorStats {
+    std::uint64_t sweeps = 0;            // Sweeps run (GC commands and background passes)
+    std::uint64_t versions = 0;          // Versions reclaimed
+    std::uint64_t bytes = 0;             // Bytes reclaimed
+};
+
+// GarbageCollector removes the versions a retention policy lets go (see File::Unretained)
+// and compacts what is left of each file. A sweep visits files one at a time, each under
+// its own lock. Removals are handed to the logger while the file is still locked, so that
+// durable mode can log them in order with the file's other mutations. A background thread
+// can sweep every file at a fixed interval; sweep() can also be called directly.
+class GarbageCollector {
+public:
+    typedef void (*Logger)(File* f, const std::vector<int>& removed);
+
+private:
+    ShardedFileTable& table;
+    RwLock& state_lock;         // Held shared while a file is collected (checkpoints hold it exclusively)
+    RetentionPolicy policy;
+    Logger logger;
+
+    std::atomic<std::uint64_t> sweeps, versions, bytes;
+    PeriodicWorker worker;      // Sweeps in the background once started
+
+    // Collects one file; returns false if it does not exist. Unless load is set, a spilled
+    // file is skipped rather than read back, and one held by a transaction rather than
+    // waited for.
+    bool collect(const std::string& name, ReclaimStats& total, bool load) {
+        SharedLock shared(state_lock);
+        LockedFile f(table, name, load, !load);
+        if (!f) return false;
+        if (f -> Is_Spilled()) return true;
+        std::vector<int> removed = f -> Unretained(policy);
+        if (removed.empty()) return true;
+        ReclaimStats r = f -> Remove_Versions(removed);
+        if (logger) logger(f.get(), removed);
+        total.versions += r.versions;
+        total.bytes += r.bytes;
+        return true;
+    }
+
+    // Adds a finished sweep to the counters
+    void record(const ReclaimStats& r) {
+        sweeps++;
+        versions += r.versions;
+        bytes += r.bytes;
+    }
+
+public:
+    GarbageCollector(ShardedFileTable& files, RwLock& state, const RetentionPolicy& retention, Logger log)
+        : table(files), state_lock(state), policy(retention), logger(log),
+          sweeps(0), versions(0), bytes(0), worker("garbage collection", [this] {sweep();}) {}
+
+    ~GarbageCollector() {stop();}
+
+    GarbageCollector(const GarbageCollector&) = delete;
+    GarbageCollector& operator=(const GarbageCollector&) = delete;
+
+    // Starts a background thread sweeping every file once per interval
+    void start(std::chrono::milliseconds every) {worker.start(every);}
+
+    // Stops the background thread, waiting for a running sweep to finish
+    void stop() {worker.stop();}
+
+    // Collects every file that is in memory (spilled files are cold; collecting them would
+    // read them back); the caller must not hold state_lock
+    ReclaimStats sweep() {
+        ReclaimStats total;
+        for (const std::string& name : table.keys()) collect(name, total, false);
+        record(total);
+        return total;
+    }
+
+    // Collects one file; returns false if it does not exist. The caller must not hold state_lock.
+    bool sweep(const std::string& name, ReclaimStats& total) {
+        if (!collect(name, total, true)) return false;
+        record(total);
+        return true;
+    }
+
+    // Returns the counters
+    CollectorStats stats() const {
+        CollectorStats st;
+        st.sweeps = sweeps;
+        st.versions = versions;
+        st.bytes = bytes;
+        return st;
+    }
+
+    // Returns the retention policy
+    const RetentionPolicy& get_policy() const {return policy;}
+};
+
+#endif // End of include guard
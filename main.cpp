@@ -1,258 +1,183 @@
-#include "file.hpp"      // File class for versioned files
-#include "file_hash.hpp" // FileHash for mapping filenames to File*
-#include "heap.hpp"      // MaxHeap for recent and biggest files
+#include "commands.hpp"  // Command handlers, dispatch and the shared state
+#include "server.hpp"    // CommandServer for --listen
+#include "batch.hpp"     // run_batch for --batch
 #include <iostream>      // For input/output
-#include <sstream>       // For stringstream
+#include <string>        // For std::string
+#include <sstream>       // For holding back shell replies
+#include <cstdlib>       // For std::strtol
+#include <cstring>       // For std::strcmp
+#include <climits>       // For INT_MAX
+#include <chrono>        // For timing recovery
+#include <csignal>       // For SIGINT and SIGTERM
 
 using namespace std;
 
-#define ERR_COLOR_YELLOW "\033[33m"
-#define ERR_COLOR_RED "\033[31m"
-#define SUCCESS_COLOR "\033[32m"
-#define RESET_COLOR "\033[0m"
-#define EXIT_COLOR "\033[34m"
+CommandServer* server = nullptr; // Running server, or nullptr in shell mode
+StatsDumper* stats_dumper = nullptr; // Writes statistics periodically, or nullptr without --stats-every
 
-// Global file table and heaps
-FileHash file_table; // Maps filename to File*
-MaxHeap recentHeap(cmp_recent);   // Heap for most recently modified files
-MaxHeap biggestHeap(cmp_biggest); // Heap for files with most versions
-
-// Updates both heaps with the given file
-void update_heaps(File* f) {
-    recentHeap.update(f);
-    biggestHeap.update(f);
+// Stops the server on SIGINT/SIGTERM so that pending WAL records are synced on exit
+extern "C" void handle_stop_signal(int) {
+    if (server) server->stop();
 }
 
-// ---------------- COMMAND HANDLERS ----------------
+// ---------------- STARTUP ----------------
 
-// CREATE
-void handle_create(stringstream& ss) {
-    string fname;
-    if (!(ss >> fname)) {
-        cout << ERR_COLOR_YELLOW << "Error: Invalid command. Usage: CREATE <filename>" << endl << RESET_COLOR;
-        return;
-    }
-    if (file_table.exists(fname)) {
-        cout << ERR_COLOR_YELLOW << "Error: File '" << fname << "' already exists." << endl << RESET_COLOR;
-        return;
-    }
-    File* f = new File(fname);
-    file_table.put(fname, f);
-    recentHeap.insert(f);
-    biggestHeap.insert(f);
-    cout << SUCCESS_COLOR << "File '" << fname << "' created successfully." << endl << RESET_COLOR;
+// Prints command-line usage
+void print_usage(const char* prog) {
+    cerr << "Usage: " << prog << " [--data-dir <dir>] [--sync-every <records>] [--sync-ms <ms>]"
+         << " [--checkpoint-every <records>] [--listen unix:<path>|tcp:[<host>:]<port>] [--batch] [--epoch-seconds]"
+         << " [--memory-budget <MiB>] [--cache-mb <MiB>] [--spill-budget <MiB>] [--spill-dir <dir>] [--search-index]"
+         << " [--keep-last <snapshots>] [--keep-newer <seconds>] [--gc-every <seconds>]"
+         << " [--stats-every <seconds>] [--stats-file <path>]" << endl;
 }
 
-// READ
-void handle_read(stringstream& ss) {
-    string fname;
-    if (!(ss >> fname)) {
-        cout << ERR_COLOR_YELLOW << "Error: Invalid command. Usage: READ <filename>" << endl << RESET_COLOR;
-        return;
-    }
-    File* f = file_table.get(fname);
-    if (!f) { 
-        cout << ERR_COLOR_YELLOW << "Error: File '" << fname << "' not found." << endl << RESET_COLOR; 
-        return; 
-    }
-    cout << SUCCESS_COLOR << "Content of '" << fname << "' (Version " 
-         << f->get_active_version()->get_version_id() << "):" << endl
-         << f->Read() << "" << endl << RESET_COLOR;
+// Parses command-line options; returns false on invalid input. budget_mb stays -1 unless
+// --memory-budget is given, spill_mb unless --spill-budget is, gc_every_s unless --gc-every
+// is, stats_every_s unless --stats-every is.
+bool parse_options(int argc, char** argv, StorageOptions& opts, string& listen_addr, bool& batch,
+                   long& budget_mb, long& cache_mb, long& spill_mb, string& spill_dir, RetentionPolicy& retention,
+                   long& gc_every_s, long& stats_every_s, string& stats_file) {
+    for (int i = 1; i < argc; i++) {
+        const char* opt = argv[i];
+        if (strcmp(opt, "--batch") == 0) {batch = true; continue;}
+        if (strcmp(opt, "--epoch-seconds") == 0) {whole_second_times = true; continue;}
+        if (strcmp(opt, "--search-index") == 0) {TextIndex::instance().enable(); continue;}
+        if (i + 1 >= argc) return false;
+        const char* val = argv[++i];
+        char* end;
+        long n = strtol(val, &end, 10);
+        bool numeric = *val && !*end && n >= 0;
+        if (strcmp(opt, "--data-dir") == 0) opts.dir = val;
+        else if (strcmp(opt, "--listen") == 0) listen_addr = val;
+        else if (strcmp(opt, "--sync-every") == 0 && numeric && n > 0) opts.sync_every = n;
+        else if (strcmp(opt, "--sync-ms") == 0 && numeric) opts.sync_ms = n;
+        else if (strcmp(opt, "--checkpoint-every") == 0 && numeric) opts.checkpoint_every = n;
+        else if (strcmp(opt, "--memory-budget") == 0 && numeric) budget_mb = n;
+        else if (strcmp(opt, "--cache-mb") == 0 && numeric) cache_mb = n;
+        else if (strcmp(opt, "--spill-budget") == 0 && numeric) spill_mb = n;
+        else if (strcmp(opt, "--spill-dir") == 0) spill_dir = val;
+        else if (strcmp(opt, "--keep-last") == 0 && numeric && n <= INT_MAX) retention.keep_last = n;
+        else if (strcmp(opt, "--keep-newer") == 0 && numeric) retention.keep_newer = static_cast<Clock::time_point>(n) * Clock::MICROS_PER_SECOND;
+        else if (strcmp(opt, "--gc-every") == 0 && numeric && n > 0) gc_every_s = n;
+        else if (strcmp(opt, "--stats-every") == 0 && numeric && n > 0 && Stats::ENABLED) stats_every_s = n;
+        else if (strcmp(opt, "--stats-file") == 0) stats_file = val;
+        else return false;
+    }
+    return true;
 }
 
-// INSERT / UPDATE
-void handle_insert_update(stringstream& ss, bool is_insert) {
-    string fname;
-    if (!(ss >> fname)) {
-        cout << ERR_COLOR_YELLOW << "Error: Invalid command. Usage: " 
-             << (is_insert ? "INSERT" : "UPDATE") << " <filename> <content>" << endl << RESET_COLOR;
-        return;
-    }
-    string content;
-    getline(ss, content);
-    if (content.empty() || content == " ") {
-        cout << ERR_COLOR_YELLOW << "Error: Invalid command. Usage: " 
-             << (is_insert ? "INSERT" : "UPDATE") << " <filename> <content>" << endl << RESET_COLOR;
-        return;
-    }
-    if (content[0] == ' ') content.erase(0,1);
-
-    File* f = file_table.get(fname);
-    if (!f) {
-        cout << ERR_COLOR_YELLOW << "Error: File '" << fname << "' not found." << endl << RESET_COLOR;
-        return;
-    }
-
-    if (is_insert) f->Insert(content);
-    else f->Update(content);
-
-    update_heaps(f);
+// Opens durable storage and restores the checkpoint plus WAL tail
+void recover_storage(const StorageOptions& opts) {
+    auto start = chrono::steady_clock::now();
+    storage = new Storage(opts);
+    RecoveryStats rs = storage->recover(register_file, apply_record);
+    auto ms = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+    cerr << "Recovered " << rs.files_loaded << " file(s) from checkpoint and replayed "
+         << rs.records_replayed << " WAL record(s) in " << ms << " ms"
+         << (rs.torn_tail ? " (discarded a torn WAL tail)." : ".") << endl;
+}
 
-    TreeNode* active = f->get_active_version();
-    TreeNode* parent = active->get_parent();
-    cout << SUCCESS_COLOR << "New version " << active->get_version_id()
-         << " created for '" << fname
-         << "'. Parent is version "
-         << (parent ? parent->get_version_id() : -1)
-         << "." << endl << RESET_COLOR;
+// Stops the statistics dump, the spiller, the compactor and the collector and closes durable storage
+void shutdown_state() {
+    delete stats_dumper; // Waits for a running dump
+    stats_dumper = nullptr;
+    delete spiller; // Waits for a running pass
+    spiller = nullptr;
+    delete compactor; // Waits for a running pass
+    compactor = nullptr;
+    delete collector; // Waits for a running sweep
+    collector = nullptr;
+    delete storage; // Flushes unsynced WAL records
+    storage = nullptr;
 }
 
-// SNAPSHOT
-void handle_snapshot(stringstream& ss) {
-    string fname;
-    if (!(ss >> fname)) {
-        cout << ERR_COLOR_YELLOW << "Error: Invalid command. Usage: SNAPSHOT <filename> <message>" << endl << RESET_COLOR;
-        return;
-    }
-    string message;
-    getline(ss, message);
-    if (message.empty() || message == " ") {
-        cout << ERR_COLOR_YELLOW << "Error: Invalid command. Usage: SNAPSHOT <filename> <message>" << endl << RESET_COLOR;
-        return;
-    }
-    if (message[0] == ' ') message.erase(0,1);
+// ---------------- MAIN LOOP ----------------
 
-    File* f = file_table.get(fname);
-    if (!f) {
-        cout << ERR_COLOR_YELLOW << "Error: File '" << fname << "' not found." << endl << RESET_COLOR;
-        return;
-    }
+int main(int argc, char** argv) {
+    ios::sync_with_stdio(false);
+    cin.tie(nullptr);
 
-    try {
-        f->Snapshot(message);
-        cout << SUCCESS_COLOR << "Snapshot created for '" << fname 
-             << "' with message: " << message << "" << endl << RESET_COLOR;
-    } catch (const exception& e) {
-        cout << ERR_COLOR_YELLOW << "Error: " << e.what() << "" << endl << RESET_COLOR;
+    StorageOptions opts;
+    string listen_addr, stats_file, spill_dir;
+    bool batch = false;
+    long budget_mb = -1, cache_mb = -1, spill_mb = -1, gc_every_s = -1, stats_every_s = -1;
+    RetentionPolicy retention;
+    if (!parse_options(argc, argv, opts, listen_addr, batch, budget_mb, cache_mb, spill_mb, spill_dir, retention,
+                       gc_every_s, stats_every_s, stats_file)
+        || (batch && !listen_addr.empty())) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    if (!opts.dir.empty()) {
+        try {
+            recover_storage(opts);
+        } catch (exception& e) {
+            cerr << "Error: recovery failed: " << e.what() << endl;
+            return 1;
+        }
     }
-}
-
-// ROLLBACK
-void handle_rollback(stringstream& ss) {
-    string fname;
-    if (!(ss >> fname)) {
-        cout << ERR_COLOR_YELLOW << "Error: Invalid command. Usage: ROLLBACK <filename> [versionID]" << endl << RESET_COLOR;
-        return;
+    if (cache_mb >= 0) ContentCache::instance().set_budget(static_cast<size_t>(cache_mb) << 20);
+    if (budget_mb >= 0) {
+        compactor = new Compactor(file_table, state_lock, static_cast<size_t>(budget_mb) << 20);
+        compactor->start();
     }
-    File* f = file_table.get(fname);
-    if (!f) { 
-        cout << ERR_COLOR_YELLOW << "Error: File '" << fname << "' not found." << endl << RESET_COLOR; 
-        return;
+    if (spill_mb >= 0) {
+        if (spill_dir.empty()) spill_dir = opts.dir.empty() ? "spill" : opts.dir + "/spill";
+        try {
+            spiller = new Spiller(file_table, state_lock, spill_dir, static_cast<size_t>(spill_mb) << 20);
+        } catch (exception& e) {
+            cerr << "Error: " << e.what() << endl;
+            shutdown_state();
+            return 1;
+        }
+        file_table.set_loader(load_file);
+        spiller->start();
     }
+    collector = new GarbageCollector(file_table, state_lock, retention, log_removed);
+    if (gc_every_s > 0) collector->start(chrono::seconds(gc_every_s));
+    if (stats_every_s > 0) stats_dumper = new StatsDumper(write_stats_json, stats_file, chrono::seconds(stats_every_s));
 
-    int versionID;
-    if (ss >> versionID) {
-        if (versionID < 0) {
-            cout << ERR_COLOR_YELLOW << "Error: VersionID must be non-negative." << endl << RESET_COLOR;
-            return;
-        }
+    if (!listen_addr.empty()) {
+        use_color = false; // Clients parse the output; escape codes only help terminals
         try {
-            f->Rollback(versionID);
-            cout << SUCCESS_COLOR << "Active version for '" << fname 
-                 << "' set to " << versionID << "." << endl << RESET_COLOR;
-        } catch (...) {
-            cout << ERR_COLOR_YELLOW << "Error: Version " << versionID 
-                 << " not found for file '" << fname << "'." << endl << RESET_COLOR;
+            server = new CommandServer(listen_addr);
+        } catch (exception& e) {
+            cerr << "Error: " << e.what() << endl;
+            shutdown_state();
+            return 1;
         }
-    } else {
-        TreeNode* active = f->get_active_version();
-        TreeNode* parent = (active ? active->get_parent() : nullptr);
-        if (!parent) {
-            cout << ERR_COLOR_YELLOW << "Error: Cannot rollback from root version." << endl << RESET_COLOR;
-            return;
-        }
-        int parentID = parent->get_version_id();
+        signal(SIGINT, handle_stop_signal);
+        signal(SIGTERM, handle_stop_signal);
+        signal(SIGPIPE, SIG_IGN);
+        cerr << "Listening on " << listen_addr << endl;
+        server->run();
+        delete server;
+    }
+    else if (batch) {
+        use_color = false;
         try {
-            f->Rollback();
-            cout << SUCCESS_COLOR << "Active version for '" << fname 
-                 << "' set to parent version " << parentID << "." << endl << RESET_COLOR;
-        } catch (const exception& e) {
-            cout << ERR_COLOR_YELLOW << "Error: " << e.what() << "" << endl << RESET_COLOR;
+            run_batch(STDIN_FILENO, STDOUT_FILENO);
+        } catch (exception& e) {
+            cerr << "Error: " << e.what() << endl;
+            shutdown_state();
+            return 1;
         }
     }
-}
-
-// HISTORY
-void handle_history(stringstream& ss) {
-    string fname;
-    if (!(ss >> fname)) {
-        cout << ERR_COLOR_YELLOW << "Error: Invalid command. Usage: HISTORY <filename>" << endl << RESET_COLOR;
-        return;
-    }
-    File* f = file_table.get(fname);
-    if (!f) { 
-        cout << ERR_COLOR_YELLOW << "Error: File '" << fname << "' not found." << endl << RESET_COLOR; 
-        return; 
-    }
-    auto hist = f->History();
-    for (auto* node : hist) {
-        cout << node->get_version_id() << " "
-             << node->get_snapshot_time() << " "
-             << node->get_message() << "" << endl;
-    }
-}
-
-void handle_heap_query(MaxHeap& heap, stringstream& ss, bool is_recent) {
-    int num;
-    if (!(ss >> num)) {
-        cout << ERR_COLOR_YELLOW << "Error: Invalid command. Usage: " 
-             << (is_recent ? "RECENT_FILES <k>" : "BIGGEST_TREES <k>") << "" << endl << RESET_COLOR;
-        return;
-    }
-    if (num <= 0) {
-        cout << ERR_COLOR_YELLOW << "Error: Invalid command. k must be positive." << endl << RESET_COLOR;
-        return;
-    }
-    if (num > heap.size()) {
-        cout << ERR_COLOR_YELLOW << "Error: k cannot exceed number of files. Currently only " 
-             << heap.size() << " file(s) exist." << endl << RESET_COLOR;
-        return;
-    }
-
-    vector<File*> results;
-    for (int i = 0; i < num; i++) {
-        File* f = heap.extract_max();
-        results.push_back(f);
-    }
-    for (File* f : results) {
-        cout << SUCCESS_COLOR << f->get_filename() << " "
-             << (is_recent ? f->get_last_modified() : f->get_total_versions()) << "" << endl << RESET_COLOR;
-        heap.insert(f); // put back
-    }
-}
-
-// ---------------- MAIN LOOP ----------------
-
-int main() {
-    ios::sync_with_stdio(false);
-    cin.tie(nullptr);
-
-    string line;
-    while (getline(cin, line)) {
-        if (line.empty()) continue;
-        stringstream ss(line);
-        string cmd;
-        ss >> cmd;
-
-        try {
-            if (cmd == "CREATE") handle_create(ss);
-            else if (cmd == "READ") handle_read(ss);
-            else if (cmd == "INSERT") handle_insert_update(ss, true);
-            else if (cmd == "UPDATE") handle_insert_update(ss, false);
-            else if (cmd == "SNAPSHOT") handle_snapshot(ss);
-            else if (cmd == "ROLLBACK") handle_rollback(ss);
-            else if (cmd == "HISTORY") handle_history(ss);
-            else if (cmd == "RECENT_FILES") handle_heap_query(recentHeap, ss, true);
-            else if (cmd == "BIGGEST_TREES") handle_heap_query(biggestHeap, ss, false);
-            else if (cmd == "EXIT") {
-                cout << EXIT_COLOR << "Exiting shell. Goodbye!" << endl << RESET_COLOR;
-                break;
+    else {
+        string line;
+        Session session;
+        while (getline(cin, line)) {
+            ostringstream reply; // Held back until what it reports is durable
+            bool open = dispatch_command(Slice(line.data(), line.size()), reply, session);
+            try {
+                await_durable();
+            } catch (exception& e) {
+                reply << "Error: " << e.what() << endl;
             }
-            else cout << ERR_COLOR_RED << "Error: Unknown command '" << cmd << "'." << endl << RESET_COLOR;
-        }
-        catch (exception& e) {
-            cout << ERR_COLOR_YELLOW << "Error: " << e.what() << "" << endl << RESET_COLOR;
+            cout << reply.str() << flush;
+            if (!open) break;
         }
     }
+    shutdown_state();
     return 0;
 }
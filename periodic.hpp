@@ -0,0 +1,73 @@
+// periodic.hpp
+#ifndef PERIODIC_HPP // Prevents multiple inclusion of this header file
+#define PERIODIC_HPP
+
+#include <string>            // For std::string
+#include <functional>        // For std::function
+#include <thread>            // For the background thread
+#include <mutex>             // For std::mutex
+#include <condition_variable> // For waking the thread on stop
+#include <chrono>            // For the interval
+#include <exception>         // For std::exception
+#include <iostream>          // For reporting errors on stderr
+
+// PeriodicWorker runs a task on a background thread once every interval until it is
+// stopped. The compactor, the spiller, the garbage collector and the statistics dump each
+// own one. A task that throws is reported on stderr ("Error: <what> failed: ...") and runs
+// again at the next interval. Stopping waits for a running task to finish.
+class PeriodicWorker {
+public:
+    typedef std::function<void()> Task;
+
+private:
+    std::string what;           // Names the task in error messages
+    Task task;
+    std::chrono::milliseconds interval;
+
+    std::thread worker;
+    std::mutex wake_lock;
+    std::condition_variable wake;
+    bool stopping;              // Guarded by wake_lock
+
+    void loop() {
+        std::unique_lock<std::mutex> guard(wake_lock);
+        while (!stopping) {
+            wake.wait_for(guard, interval, [this] {return stopping;});
+            if (stopping) break;
+            guard.unlock();
+            try {
+                task();
+            } catch (std::exception& e) {
+                std::cerr << "Error: " << what << " failed: " << e.what() << std::endl;
+            }
+            guard.lock();
+        }
+    }
+
+public:
+    PeriodicWorker(const std::string& name, Task t) : what(name), task(t), interval(0), stopping(false) {}
+
+    ~PeriodicWorker() {stop();}
+
+    PeriodicWorker(const PeriodicWorker&) = delete;
+    PeriodicWorker& operator=(const PeriodicWorker&) = delete;
+
+    // Starts the background thread, running the task once per interval
+    void start(std::chrono::milliseconds every) {
+        if (worker.joinable()) return;
+        interval = every;
+        worker = std::thread(&PeriodicWorker::loop, this);
+    }
+
+    // Stops the background thread, waiting for a running task to finish
+    void stop() {
+        {
+            std::lock_guard<std::mutex> guard(wake_lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        if (worker.joinable()) worker.join();
+    }
+};
+
+#endif // End of include guard
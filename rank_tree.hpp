@@ -0,0 +1,280 @@
+// rank_tree.hpp
+#ifndef RANK_TREE_HPP // Prevents multiple inclusion of this header file
+#define RANK_TREE_HPP
+
+#include "file.hpp"      // Includes File class definition
+#include "stats.hpp"     // Stats for insertion depths
+#include <vector>        // For std::vector
+#include <utility>       // For std::pair
+#include <algorithm>     // For std::sort
+#include <stdexcept>     // For exception handling
+#include <cstdint>       // For std::uint32_t and std::uint64_t
+#include <cstddef>       // For std::size_t
+
+// RankTree keeps files in rank order under the Compare functor, as an order-statistic
+// treap: a binary search tree in rank order whose nodes are also heap-ordered by a
+// pseudo-random priority (a hash of the file's handle), which keeps its depth O(log n) in
+// expectation whatever order files arrive in. Every node counts the nodes in its subtree,
+// so the i-th file and the position of a file are found from the root in O(log n).
+// Compare::key(f) extracts a file's ranking key and Compare(a, b) returns true when key a
+// ranks above key b; files with equal keys rank by name. Each node caches its file's key,
+// taken when the file is inserted or updated, so the tree never reads another file's key
+// (which other threads may be modifying); names never change. Nodes are stored by file
+// handle, so a file's node is found without searching.
+template <typename Compare>
+class RankTree {
+public:
+    typedef typename Compare::key_type Key; // Ranking key type
+
+private:
+    static constexpr int NIL = -1;
+
+    // Tree node of one file; file is nullptr while the handle is not in the tree
+    struct Node {
+        Key key;
+        File* file;
+        int left, right;
+        int size;                // Nodes in this subtree
+        std::uint32_t priority;  // Parents have higher priorities than their children
+    };
+
+    std::vector<Node> nodes;     // Indexed by file handle
+    int root = NIL;
+    Compare cmp;
+
+    // Returns the priority of a handle (splitmix64 of it)
+    static std::uint32_t priority_of(int handle) {
+        std::uint64_t z = static_cast<std::uint64_t>(handle) + 0x9e3779b97f4a7c15ULL;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return static_cast<std::uint32_t>(z ^ (z >> 31));
+    }
+
+    int size_of(int t) const {return t == NIL ? 0 : nodes[t].size;}
+
+    // Recomputes the subtree size of t from its children
+    void pull(int t) {nodes[t].size = 1 + size_of(nodes[t].left) + size_of(nodes[t].right);}
+
+    // Returns true if node a ranks above node b
+    bool above(int a, int b) const {
+        if (cmp(nodes[a].key, nodes[b].key)) return true;
+        if (cmp(nodes[b].key, nodes[a].key)) return false;
+        return nodes[a].file -> get_filename() < nodes[b].file -> get_filename();
+    }
+
+    // Splits subtree t into the nodes ranking above x (l) and below it (r)
+    void split(int t, int x, int& l, int& r) {
+        if (t == NIL) {
+            l = r = NIL;
+            return;
+        }
+        if (above(t, x)) {
+            split(nodes[t].right, x, nodes[t].right, r);
+            l = t;
+        }
+        else {
+            split(nodes[t].left, x, l, nodes[t].left);
+            r = t;
+        }
+        pull(t);
+    }
+
+    // Joins two subtrees, every node of a ranking above every node of b
+    int merge(int a, int b) {
+        if (a == NIL) return b;
+        if (b == NIL) return a;
+        if (nodes[a].priority > nodes[b].priority) {
+            nodes[a].right = merge(nodes[a].right, b);
+            pull(a);
+            return a;
+        }
+        nodes[b].left = merge(a, nodes[b].left);
+        pull(b);
+        return b;
+    }
+
+    // Inserts node x into subtree t, depth levels below the root; returns the new subtree
+    int insert_at(int t, int x, int depth) {
+        if (t == NIL || nodes[x].priority > nodes[t].priority) {
+            split(t, x, nodes[x].left, nodes[x].right);
+            pull(x);
+            Stats::ranked(depth);
+            return x;
+        }
+        if (above(x, t)) nodes[t].left = insert_at(nodes[t].left, x, depth + 1);
+        else nodes[t].right = insert_at(nodes[t].right, x, depth + 1);
+        pull(t);
+        return t;
+    }
+
+    // Removes node x from subtree t; returns the new subtree
+    int erase_at(int t, int x) {
+        if (t == NIL) throw std::logic_error("Ranking tree is inconsistent");
+        if (t == x) return merge(nodes[t].left, nodes[t].right);
+        if (above(x, t)) nodes[t].left = erase_at(nodes[t].left, x);
+        else nodes[t].right = erase_at(nodes[t].right, x);
+        pull(t);
+        return t;
+    }
+
+    // Appends the nodes of subtree t in rank order, after skipping `skip` of them, until
+    // out holds k entries
+    void collect(int t, int& skip, std::size_t k, std::vector<std::pair<File*, Key>>& out) const {
+        if (t == NIL || out.size() >= k) return;
+        if (skip >= nodes[t].size) {
+            skip -= nodes[t].size;
+            return;
+        }
+        collect(nodes[t].left, skip, k, out);
+        if (out.size() >= k) return;
+        if (skip > 0) skip--;
+        else out.emplace_back(nodes[t].file, nodes[t].key);
+        collect(nodes[t].right, skip, k, out);
+    }
+
+    // Recomputes the sizes of subtree t bottom-up; returns its size
+    int fix_sizes(int t) {
+        if (t == NIL) return 0;
+        nodes[t].size = 1 + fix_sizes(nodes[t].left) + fix_sizes(nodes[t].right);
+        return nodes[t].size;
+    }
+
+    // Returns the node of f, or NIL if f is not in the tree
+    int node_of(const File* f) const {
+        int h = f -> get_handle();
+        return h < static_cast<int>(nodes.size()) && nodes[h].file == f ? h : NIL;
+    }
+
+public:
+    // Constructor: creates an empty tree with the given comparator
+    RankTree(Compare cmp_func = Compare()) : cmp(cmp_func) {}
+
+    // Returns true if the tree is empty
+    bool empty() const {return root == NIL;}
+    // Returns the number of files in the tree
+    int size() const {return size_of(root);}
+
+    // Inserts a file; O(log n)
+    void insert(File* f) {
+        int h = f -> get_handle();
+        if (h >= static_cast<int>(nodes.size())) nodes.resize(h + 1, Node{Key(), nullptr, NIL, NIL, 0, 0});
+        if (nodes[h].file) throw std::invalid_argument("File already ranked");
+        nodes[h] = Node{Compare::key(f), f, NIL, NIL, 1, priority_of(h)};
+        root = insert_at(root, h, 0);
+    }
+
+    // Removes a file; O(log n)
+    void remove(File* f) {
+        int x = node_of(f);
+        if (x == NIL) throw std::invalid_argument("File not found in ranking");
+        root = erase_at(root, x);
+        nodes[x].file = nullptr;
+    }
+
+    // Refreshes the cached key of a file and moves it to its new rank; O(log n), and O(1)
+    // if the key did not change
+    void update(File* f) {
+        int x = node_of(f);
+        if (x == NIL) throw std::invalid_argument("File not found in ranking");
+        Key k = Compare::key(f);
+        if (!cmp(k, nodes[x].key) && !cmp(nodes[x].key, k)) return;
+        root = erase_at(root, x);
+        nodes[x].key = k;
+        nodes[x].left = nodes[x].right = NIL;
+        nodes[x].size = 1;
+        root = insert_at(root, x, 0);
+    }
+
+    // Refreshes the cached key of every file and rebuilds the tree from the sorted files
+    // in one pass (a stack of the right spine), cheaper than update() on each file once
+    // most have changed. Reads every file, so no file may be modified meanwhile.
+    void rebuild() {
+        std::vector<int> order;
+        order.reserve(size());
+        for (int h = 0; h < static_cast<int>(nodes.size()); h++) {
+            if (!nodes[h].file) continue;
+            nodes[h].key = Compare::key(nodes[h].file);
+            nodes[h].left = nodes[h].right = NIL;
+            order.push_back(h);
+        }
+        std::sort(order.begin(), order.end(), [this](int a, int b) {return above(a, b);});
+        std::vector<int> spine; // Right spine of the tree built so far, top first
+        for (int x : order) {
+            int last = NIL;
+            while (!spine.empty() && nodes[spine.back()].priority < nodes[x].priority) {
+                last = spine.back();
+                spine.pop_back();
+            }
+            nodes[x].left = last;
+            if (!spine.empty()) nodes[spine.back()].right = x;
+            spine.push_back(x);
+        }
+        root = spine.empty() ? NIL : spine.front();
+        fix_sizes(root);
+    }
+
+    // Returns k files with their cached keys in rank order, starting after the first
+    // `offset`; fewer once the end is reached. O(log n + k).
+    std::vector<std::pair<File*, Key>> top_k(int k, int offset = 0) const {
+        std::vector<std::pair<File*, Key>> result;
+        if (k <= 0 || offset < 0) return result;
+        result.reserve(k);
+        collect(root, offset, k, result);
+        return result;
+    }
+
+    // Returns the 1-based rank of a file, or 0 if it is not in the tree; O(log n)
+    int rank(const File* f) const {
+        int x = node_of(f);
+        if (x == NIL) return 0;
+        int r = 0;
+        int t = root;
+        while (t != x) {
+            if (above(x, t)) t = nodes[t].left;
+            else {
+                r += size_of(nodes[t].left) + 1;
+                t = nodes[t].right;
+            }
+        }
+        return r + size_of(nodes[x].left) + 1;
+    }
+
+    // Returns the number of files whose key ranks above k (or, if inclusive, does not
+    // rank below it); O(log n)
+    int count_above(const Key& k, bool inclusive) const {
+        int n = 0;
+        int t = root;
+        while (t != NIL) {
+            bool counted = inclusive ? !cmp(k, nodes[t].key) : cmp(nodes[t].key, k);
+            if (counted) {
+                n += size_of(nodes[t].left) + 1;
+                t = nodes[t].right;
+            }
+            else t = nodes[t].left;
+        }
+        return n;
+    }
+
+    // Returns the files whose keys lie from `first` down to `last` in rank order (first
+    // ranks above last), with their cached keys; O(log n + results)
+    std::vector<std::pair<File*, Key>> between(const Key& first, const Key& last) const {
+        int from = count_above(first, false);
+        return top_k(count_above(last, true) - from, from);
+    }
+};
+
+// Comparator for most recently modified files
+struct RecentCmp {
+    typedef Clock::time_point key_type;
+    static key_type key(const File* f) {return f -> get_last_modified();}
+    bool operator()(key_type a, key_type b) const {return a > b;}
+};
+
+// Comparator for files with most versions
+struct BiggestCmp {
+    typedef int key_type;
+    static key_type key(const File* f) {return f -> get_total_versions();}
+    bool operator()(key_type a, key_type b) const {return a > b;}
+};
+
+#endif // End of include guard
@@ -0,0 +1,351 @@
+// rope.hpp
+#ifndef ROPE_HPP // Prevents multiple inclusion of this header file
+#define ROPE_HPP
+
+#include <string>        // For std::string
+#include <vector>        // For std::vector
+#include <memory>        // For std::shared_ptr and std::unique_ptr
+#include <atomic>        // For the chunk write frontier
+#include <ostream>       // For std::ostream
+#include <cstddef>       // For std::size_t
+#include <cstring>       // For std::memcpy and std::memcmp
+#include <cstdint>       // For std::uint64_t
+#include <unordered_set> // For counting shared chunks once
+#include <utility>       // For std::move
+
+// Chunk class is a block of content bytes shared by any number of ropes.
+// Bytes before the write frontier (size()) never change. A heap chunk can be extended
+// past the frontier, but only by the one rope whose content currently ends there, so
+// every other rope keeps seeing exactly the prefix it was built from. A view chunk
+// wraps memory owned elsewhere (e.g. a mapped checkpoint) and is read-only.
+class Chunk {
+private:
+    std::unique_ptr<char[]> owned;      // Heap buffer (null for views)
+    const char* bytes;                  // Start of the chunk's bytes
+    std::size_t cap;                    // Capacity in bytes (equals size for views)
+    std::atomic<std::size_t> used;      // Write frontier: bytes written so far
+    std::shared_ptr<const void> owner;  // Keeps a view's backing memory alive
+
+    Chunk(std::size_t capacity)
+        : owned(new char[capacity]), bytes(owned.get()), cap(capacity), used(0) {}
+    Chunk(const char* data, std::size_t size, std::shared_ptr<const void> keep_alive)
+        : bytes(data), cap(size), used(size), owner(std::move(keep_alive)) {}
+
+public:
+    // Creates an empty heap chunk with the given capacity
+    static std::shared_ptr<Chunk> make_owned(std::size_t capacity) {
+        return std::shared_ptr<Chunk>(new Chunk(capacity));
+    }
+    // Creates a read-only chunk over memory kept alive by keep_alive
+    static std::shared_ptr<Chunk> make_view(const char* data, std::size_t size, std::shared_ptr<const void> keep_alive) {
+        return std::shared_ptr<Chunk>(new Chunk(data, size, std::move(keep_alive)));
+    }
+
+    Chunk(const Chunk&) = delete;
+    Chunk& operator=(const Chunk&) = delete;
+
+    const char* data() const {return bytes;} // Returns the chunk's bytes
+    std::size_t size() const {return used.load(std::memory_order_acquire);} // Returns bytes written
+    std::size_t capacity() const {return cap;} // Returns capacity in bytes
+    bool is_view() const {return !owned;} // True for read-only views
+
+    // Writes n bytes at offset at if at is still the write frontier and they fit.
+    // Returns false (writing nothing) if another rope already extended the chunk.
+    bool try_append(std::size_t at, const char* src, std::size_t n) {
+        if (!owned || n > cap - at) return false;
+        std::size_t expected = at;
+        if (!used.compare_exchange_strong(expected, at + n, std::memory_order_acq_rel)) return false;
+        std::memcpy(owned.get() + at, src, n); // The claimed range is private to the caller
+        return true;
+    }
+};
+
+// ContentHash computes a 64-bit hash of a byte stream fed in any number of parts; the
+// result depends only on the bytes, not on how they were split. It mixes 8 bytes at a
+// time, so hashing costs about one multiply chain per word.
+class ContentHash {
+private:
+    std::uint64_t h = 0x9e3779b97f4a7c15ULL; // Running state
+    std::uint64_t length = 0;                // Bytes fed so far
+    unsigned char tail[8];                   // Bytes not yet forming a full word
+    unsigned tail_len = 0;                   // Number of bytes in tail
+
+    static std::uint64_t rotl(std::uint64_t x, int r) {return (x << r) | (x >> (64 - r));}
+
+    // Mixes one 8-byte word into the state
+    void mix(std::uint64_t w) {
+        w *= 0x87c37b91114253d5ULL;
+        w = rotl(w, 31);
+        w *= 0x4cf5ad432745937fULL;
+        h ^= w;
+        h = rotl(h, 27) * 5 + 0x52dce729;
+    }
+
+public:
+    // Feeds n more bytes
+    void update(const char* p, std::size_t n) {
+        length += n;
+        if (tail_len) { // Complete the pending word first
+            while (n > 0 && tail_len < 8) {tail[tail_len++] = *p++; n--;}
+            if (tail_len < 8) return;
+            std::uint64_t w;
+            std::memcpy(&w, tail, 8);
+            mix(w);
+            tail_len = 0;
+        }
+        for (; n >= 8; p += 8, n -= 8) {
+            std::uint64_t w;
+            std::memcpy(&w, p, 8);
+            mix(w);
+        }
+        while (n > 0) {tail[tail_len++] = *p++; n--;}
+    }
+
+    // Returns the hash of all bytes fed so far (the state is not changed)
+    std::uint64_t digest() const {
+        ContentHash c = *this;
+        if (c.tail_len) {
+            std::uint64_t w = 0;
+            std::memcpy(&w, c.tail, c.tail_len);
+            c.mix(w);
+        }
+        std::uint64_t x = c.h ^ length; // splitmix64 finalizer
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+};
+
+class ContentStore; // Interns rope contents (content_store.hpp)
+
+// Rope class stores file content as a list of pieces, each a byte range of a shared chunk,
+// so that appending only touches the appended bytes instead of copying the whole content.
+// The piece list is shared copy-on-write, so copying a rope (e.g. when a child version
+// starts from its parent's content) is O(1). Versions keep sharing every chunk, including
+// a partially filled last chunk: whichever version appends first extends it in place.
+// A rope keeps a running hash of its content, so comparing or interning content (see
+// ContentStore) does not need to read it again.
+class Rope {
+private:
+    friend class ContentStore;
+
+public:
+    typedef std::shared_ptr<Chunk> ChunkPtr; // Shared handle to one chunk
+
+    // Piece is the byte range [off, off + len) of a chunk
+    struct Piece {
+        ChunkPtr chunk;  // Chunk holding the bytes
+        std::size_t off; // Offset of the first byte in the chunk
+        std::size_t len; // Number of bytes
+        const char* data() const {return chunk -> data() + off;}
+    };
+
+private:
+    static constexpr std::size_t CHUNK_SIZE = 4096; // Largest heap chunk in bytes
+    static constexpr std::size_t MIN_CHUNK = 64;    // Smallest heap chunk in bytes
+
+    // Shared piece list
+    struct Rep {
+        std::vector<Piece> pieces;    // Content pieces in order
+        std::size_t total_size = 0;   // Total number of bytes across all pieces
+        ContentHash hash;             // Hash of the content so far
+        bool hash_valid = true;       // False for ropes built from pieces; hashed on demand
+        bool interned = false;        // Registered in the ContentStore; never modified again
+    };
+
+    std::shared_ptr<Rep> rep; // Null for an empty rope
+
+    // Makes sure this rope owns its piece list before mutating it
+    void detach() {
+        if (!rep) rep = std::make_shared<Rep>();
+        else if (rep.use_count() > 1 || rep -> interned) {
+            std::shared_ptr<Rep> copy = std::make_shared<Rep>(*rep); // Copies piece handles only
+            copy -> interned = false;
+            rep = std::move(copy);
+        }
+    }
+
+    // Returns true if both ropes hold the same bytes, comparing them piece by piece
+    bool equal_bytes(const Rope& o) const {
+        if (size() != o.size()) return false;
+        if (empty()) return true;
+        const std::vector<Piece>& a = rep -> pieces;
+        const std::vector<Piece>& b = o.rep -> pieces;
+        std::size_t i = 0, j = 0, ai = 0, bj = 0; // Piece indices and offsets within them
+        while (i < a.size() && j < b.size()) {
+            std::size_t n = a[i].len - ai < b[j].len - bj ? a[i].len - ai : b[j].len - bj;
+            if (std::memcmp(a[i].data() + ai, b[j].data() + bj, n) != 0) return false;
+            ai += n;
+            bj += n;
+            if (ai == a[i].len) {i++; ai = 0;}
+            if (bj == b[j].len) {j++; bj = 0;}
+        }
+        return true;
+    }
+
+    // Returns the heap chunk capacity to use for n bytes: a power of two in [MIN_CHUNK, CHUNK_SIZE]
+    static std::size_t chunk_capacity(std::size_t n) {
+        std::size_t cap = MIN_CHUNK;
+        while (cap < n && cap < CHUNK_SIZE) cap *= 2;
+        return cap;
+    }
+
+public:
+    // Constructor: creates an empty rope
+    Rope() = default;
+
+    // Constructor: creates a rope holding a copy of the given string
+    Rope(const std::string& s) {
+        append(s);
+    }
+
+    // Appends bytes to the end of the rope; amortized O(appended bytes)
+    void append(const std::string& s) {
+        if (s.empty()) return;
+        detach();
+        std::vector<Piece>& pieces = rep -> pieces;
+        const char* src = s.data();
+        std::size_t left = s.size();
+        while (left > 0) {
+            if (!pieces.empty()) {
+                Piece& last = pieces.back();
+                std::size_t at = last.off + last.len;
+                std::size_t room = last.chunk -> capacity() - at;
+                std::size_t take = left < room ? left : room;
+                if (take > 0 && last.chunk -> try_append(at, src, take)) { // Extend in place
+                    last.len += take;
+                    src += take;
+                    left -= take;
+                    continue;
+                }
+                if (!last.chunk -> is_view() && last.len < CHUNK_SIZE) {
+                    // Tail is small but cannot grow in place: move it into a larger private chunk
+                    ChunkPtr bigger = Chunk::make_owned(chunk_capacity(last.len + left > 2 * last.len ? last.len + left : 2 * last.len));
+                    bigger -> try_append(0, last.data(), last.len);
+                    last = Piece{bigger, 0, last.len};
+                    continue;
+                }
+            }
+            pieces.push_back(Piece{Chunk::make_owned(chunk_capacity(left)), 0, 0}); // Start a new chunk
+        }
+        rep -> total_size += s.size();
+        if (rep -> hash_valid) rep -> hash.update(s.data(), s.size());
+    }
+
+    // Removes all content
+    void clear() {
+        rep.reset();
+    }
+
+    // Returns the total content length in bytes
+    std::size_t size() const {return rep ? rep -> total_size : 0;}
+    // Returns true if the rope holds no content
+    bool empty() const {return size() == 0;}
+
+    // Flattens the rope into one contiguous string
+    std::string str() const {
+        std::string out;
+        if (!rep) return out;
+        out.reserve(rep -> total_size);
+        for (const auto& p : rep -> pieces) {out.append(p.data(), p.len);}
+        return out;
+    }
+
+    // Writes the content piece by piece without flattening it first
+    void write_to(std::ostream& os) const {
+        if (!rep) return;
+        for (const auto& p : rep -> pieces) {os.write(p.data(), p.len);}
+    }
+
+    // Copies the last min(n, size()) bytes to dst; returns how many were copied
+    std::size_t copy_tail(char* dst, std::size_t n) const {
+        std::size_t k = n < size() ? n : size();
+        std::size_t need = k;
+        if (!k) return 0;
+        for (auto it = rep -> pieces.rbegin(); need > 0; ++it) {
+            std::size_t take = it -> len < need ? it -> len : need;
+            std::memcpy(dst + need - take, it -> data() + it -> len - take, take);
+            need -= take;
+        }
+        return k;
+    }
+
+    // Calls fn on every piece in order
+    template <typename Fn>
+    void for_each_piece(Fn fn) const {
+        if (!rep) return;
+        for (const auto& p : rep -> pieces) {fn(p);}
+    }
+
+    // Builds a rope from the given pieces (used when loading checkpoints)
+    static Rope from_pieces(std::vector<Piece> pieces) {
+        Rope r;
+        if (pieces.empty()) return r;
+        r.rep = std::make_shared<Rep>();
+        r.rep -> hash_valid = false; // Hashing now would read every byte
+        for (const auto& p : pieces) {r.rep -> total_size += p.len;}
+        r.rep -> pieces = std::move(pieces);
+        return r;
+    }
+
+    // Returns an address identifying the shared piece list (equal for ropes sharing it)
+    const void* identity() const {return rep.get();}
+
+    // Returns true if any piece lies in a read-only view (e.g. a mapped checkpoint)
+    bool mapped() const {
+        if (!rep) return false;
+        for (const auto& p : rep -> pieces) {
+            if (p.chunk -> is_view()) return true;
+        }
+        return false;
+    }
+
+    // Returns a 64-bit hash of the content; O(1) unless the rope was built from pieces
+    std::uint64_t content_hash() const {
+        if (!rep) return ContentHash().digest();
+        if (rep -> hash_valid) return rep -> hash.digest();
+        ContentHash h;
+        for (const auto& p : rep -> pieces) {h.update(p.data(), p.len);}
+        return h.digest();
+    }
+
+    // Returns true if both ropes hold the same content. O(1) when they share their piece
+    // list, differ in size or hash, or are both interned (interned ropes are unique).
+    bool same_content(const Rope& o) const {
+        if (rep == o.rep) return true;
+        if (size() != o.size()) return false;
+        if (empty()) return true;
+        if (rep -> interned && o.rep -> interned) return false;
+        if (content_hash() != o.content_hash()) return false;
+        return equal_bytes(o);
+    }
+
+    // Adds the bytes this rope keeps alive, counting chunks and piece lists already present
+    // in seen only once: to used the bytes written into its chunks, to allocated their
+    // capacity plus the chunk and piece list overhead. Views count only the bytes their
+    // pieces cover.
+    void account(std::unordered_set<const void*>& seen, std::size_t& used, std::size_t& allocated) const {
+        if (!rep || !seen.insert(rep.get()).second) return;
+        allocated += sizeof(Rep) + rep -> pieces.capacity() * sizeof(Piece);
+        for (const auto& p : rep -> pieces) {
+            if (p.chunk -> is_view()) {
+                if (seen.insert(p.data()).second) {
+                    used += p.len;
+                    allocated += p.len;
+                }
+            }
+            else if (seen.insert(p.chunk.get()).second) {
+                used += p.chunk -> size();
+                allocated += sizeof(Chunk) + p.chunk -> capacity();
+            }
+        }
+    }
+};
+
+// Streams the content of a rope
+inline std::ostream& operator<<(std::ostream& os, const Rope& r) {
+    r.write_to(os);
+    return os;
+}
+
+#endif // End of include guard
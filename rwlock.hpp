@@ -0,0 +1,70 @@
+// rwlock.hpp
+#ifndef RWLOCK_HPP // Prevents multiple inclusion of this header file
+#define RWLOCK_HPP
+
+#include <pthread.h>   // For pthread_rwlock_t
+#include <stdexcept>   // For exception handling
+#include <chrono>      // For try_lock_for timeouts
+#include <thread>      // For std::this_thread::sleep_for
+#include <ctime>       // For timespec and clock_gettime
+
+// RwLock class is a reader-writer lock (C++11 has no std::shared_mutex).
+// On glibc, waiting writers are preferred so that a steady stream of readers
+// cannot starve them.
+class RwLock {
+private:
+    pthread_rwlock_t lock_;
+
+public:
+    RwLock() {
+        pthread_rwlockattr_t attr;
+        pthread_rwlockattr_init(&attr);
+#ifdef __GLIBC__
+        pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+        if (pthread_rwlock_init(&lock_, &attr) != 0) throw std::runtime_error("Cannot initialize rwlock");
+        pthread_rwlockattr_destroy(&attr);
+    }
+    ~RwLock() {pthread_rwlock_destroy(&lock_);}
+
+    RwLock(const RwLock&) = delete;
+    RwLock& operator=(const RwLock&) = delete;
+
+    void lock() {pthread_rwlock_wrlock(&lock_);}          // Exclusive (writer) lock
+    void unlock() {pthread_rwlock_unlock(&lock_);}        // Releases either kind of lock
+    void lock_shared() {pthread_rwlock_rdlock(&lock_);}   // Shared (reader) lock
+    void unlock_shared() {pthread_rwlock_unlock(&lock_);}
+
+    // Tries to lock exclusively for at most timeout; returns true if locked. Readers that
+    // arrive meanwhile wait behind it, as with lock(), but only until it gives up.
+    bool try_lock_for(std::chrono::milliseconds timeout) {
+#ifdef __GLIBC__
+        timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        long long ns = deadline.tv_nsec + static_cast<long long>(timeout.count()) * 1000000;
+        deadline.tv_sec += ns / 1000000000;
+        deadline.tv_nsec = ns % 1000000000;
+        return pthread_rwlock_timedwrlock(&lock_, &deadline) == 0;
+#else
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (pthread_rwlock_trywrlock(&lock_) != 0) { // No timed lock; poll instead
+            if (std::chrono::steady_clock::now() >= deadline) return false;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return true;
+#endif
+    }
+};
+
+// SharedLock holds an RwLock in shared mode for its lifetime
+class SharedLock {
+private:
+    RwLock& rw;
+public:
+    explicit SharedLock(RwLock& l) : rw(l) {rw.lock_shared();}
+    ~SharedLock() {rw.unlock_shared();}
+    SharedLock(const SharedLock&) = delete;
+    SharedLock& operator=(const SharedLock&) = delete;
+};
+
+#endif // End of include guard
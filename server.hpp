@@ -0,0 +1,174 @@
+// server.hpp
+#ifndef SERVER_HPP // Prevents multiple inclusion of this header file
+#define SERVER_HPP
+
+#include "commands.hpp"  // dispatch_command and the shared state it works on
+#include <string>        // For std::string
+#include <sstream>       // For std::ostringstream
+#include <thread>        // For one thread per connection
+#include <mutex>         // For std::mutex
+#include <condition_variable> // For waiting on open connections
+#include <set>           // For the open connection fds
+#include <atomic>        // For the stop flag
+#include <cstring>       // For std::memset and std::strerror
+#include <cerrno>        // For errno
+#include <cstdlib>       // For std::atoi
+#include <stdexcept>     // For exception handling
+#include <unistd.h>      // For close and unlink
+#include <poll.h>        // For poll
+#include <netdb.h>       // For getaddrinfo
+#include <sys/socket.h>  // For socket, bind, listen, accept
+#include <sys/un.h>      // For sockaddr_un
+#include <netinet/in.h>  // For IPPROTO_TCP
+#include <netinet/tcp.h> // For TCP_NODELAY
+
+// CommandServer accepts connections on a Unix or TCP socket and runs the shell protocol
+// on each: the client sends newline-terminated commands and receives the same output the
+// interactive shell prints (without colours). Every connection gets its own thread; commands
+// from different connections run concurrently, synchronized by the locks in commands.hpp.
+//
+// Address syntax: "unix:<path>" or "tcp:[<host>:]<port>" (host defaults to 127.0.0.1).
+class CommandServer {
+private:
+    int listen_fd;                 // Listening socket
+    std::string unix_path;         // Socket path to unlink on shutdown (Unix sockets only)
+    std::atomic<bool> stopping;    // Set by stop(); ends the accept loop
+    std::mutex conn_lock;          // Guards conns
+    std::condition_variable conns_done; // Signalled when the last connection closes
+    std::set<int> conns;           // Open connection fds
+
+    // Binds and listens on a Unix socket
+    void listen_unix(const std::string& path) {
+        sockaddr_un addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof(addr.sun_path)) throw std::invalid_argument("Invalid socket path '" + path + "'");
+        std::strcpy(addr.sun_path, path.c_str());
+        listen_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listen_fd < 0) throw_errno("Cannot create socket");
+        ::unlink(path.c_str()); // Remove a stale socket left by an earlier run
+        if (::bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) throw_errno("Cannot bind " + path);
+        unix_path = path;
+    }
+
+    // Binds and listens on a TCP socket
+    void listen_tcp(const std::string& spec) {
+        std::string host = "127.0.0.1", port = spec;
+        std::size_t colon = spec.rfind(':');
+        if (colon != std::string::npos) {
+            host = spec.substr(0, colon);
+            port = spec.substr(colon + 1);
+        }
+        addrinfo hints, *res;
+        std::memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = AI_PASSIVE;
+        int rc = ::getaddrinfo(host.c_str(), port.c_str(), &hints, &res);
+        if (rc != 0) throw std::runtime_error("Cannot resolve '" + spec + "': " + gai_strerror(rc));
+        listen_fd = ::socket(res -> ai_family, res -> ai_socktype, res -> ai_protocol);
+        if (listen_fd < 0) {::freeaddrinfo(res); throw_errno("Cannot create socket");}
+        int one = 1;
+        ::setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        rc = ::bind(listen_fd, res -> ai_addr, res -> ai_addrlen);
+        ::freeaddrinfo(res);
+        if (rc != 0) throw_errno("Cannot bind " + spec);
+    }
+
+    // Runs the shell protocol on one connection until the client disconnects or sends EXIT.
+    // Each batch of complete lines received is answered with a single send, so pipelined
+    // commands cost one system call per batch instead of one per command, and in durable
+    // mode one wait for the fsync covering them.
+    void serve(int fd) {
+        std::string pending;
+        Session session; // An open transaction ends with the connection
+        char buf[16384];
+        bool open = true;
+        while (open) {
+            ssize_t n = ::recv(fd, buf, sizeof(buf), 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            pending.append(buf, n);
+            std::ostringstream out;
+            std::size_t start = 0, nl;
+            while (open && (nl = pending.find('\n', start)) != std::string::npos) {
+                std::size_t end = (nl > start && pending[nl - 1] == '\r') ? nl - 1 : nl; // Accept CRLF
+                open = dispatch_command(Slice(pending.data() + start, end - start), out, session);
+                start = nl + 1;
+            }
+            pending.erase(0, start);
+            try {
+                await_durable(); // One wait for every command of the batch
+            } catch (std::exception& e) {
+                out << "Error: " << e.what() << std::endl;
+            }
+            if (!send_all(fd, out.str())) break;
+        }
+        close_conn(fd);
+    }
+
+    // Sends all bytes; returns false if the peer went away
+    static bool send_all(int fd, const std::string& data) {
+        std::size_t sent = 0;
+        while (sent < data.size()) {
+            ssize_t n = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            sent += n;
+        }
+        return true;
+    }
+
+    // Closes a connection and wakes shutdown once none are left
+    void close_conn(int fd) {
+        std::lock_guard<std::mutex> guard(conn_lock);
+        conns.erase(fd);
+        ::close(fd);
+        if (conns.empty()) conns_done.notify_all();
+    }
+
+public:
+    // Constructor: binds the listening socket for addr (see the class comment)
+    explicit CommandServer(const std::string& addr) : listen_fd(-1), stopping(false) {
+        if (addr.compare(0, 5, "unix:") == 0) listen_unix(addr.substr(5));
+        else if (addr.compare(0, 4, "tcp:") == 0) listen_tcp(addr.substr(4));
+        else throw std::invalid_argument("Address must be unix:<path> or tcp:[<host>:]<port>");
+        if (::listen(listen_fd, 128) != 0) throw_errno("Cannot listen on " + addr);
+    }
+
+    // Destructor: closes the listening socket and removes a Unix socket file
+    ~CommandServer() {
+        if (listen_fd >= 0) ::close(listen_fd);
+        if (!unix_path.empty()) ::unlink(unix_path.c_str());
+    }
+
+    CommandServer(const CommandServer&) = delete;
+    CommandServer& operator=(const CommandServer&) = delete;
+
+    // Asks run() to return; safe to call from a signal handler
+    void stop() {stopping = true;}
+
+    // Accepts connections until stop() is called, then disconnects every client and
+    // waits for their threads to finish the command they are running
+    void run() {
+        while (!stopping) {
+            pollfd p = {listen_fd, POLLIN, 0};
+            int ready = ::poll(&p, 1, 200); // Wakes periodically to notice stop()
+            if (ready <= 0) continue;
+            int fd = ::accept(listen_fd, nullptr, nullptr);
+            if (fd < 0) continue;
+            int one = 1;
+            ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); // Fails harmlessly on Unix sockets
+            {
+                std::lock_guard<std::mutex> guard(conn_lock);
+                conns.insert(fd);
+            }
+            std::thread(&CommandServer::serve, this, fd).detach();
+        }
+        std::unique_lock<std::mutex> guard(conn_lock);
+        for (int fd : conns) ::shutdown(fd, SHUT_RDWR); // Unblocks recv in every connection thread
+        conns_done.wait(guard, [this] {return conns.empty();});
+    }
+};
+
+#endif // End of include guard
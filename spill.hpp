@@ -0,0 +1,208 @@
+// spill.hpp
+#ifndef SPILL_HPP // Prevents multiple inclusion of this header file
+#define SPILL_HPP
+
+#include "file_hash.hpp"     // ShardedFileTable and LockedFile
+#include "checkpoint.hpp"    // CheckpointIO, which writes and reads spill files
+#include "rwlock.hpp"        // RwLock and SharedLock
+#include "periodic.hpp"      // PeriodicWorker
+#include <string>            // For std::string
+#include <vector>            // For std::vector
+#include <memory>            // For std::unique_ptr
+#include <algorithm>         // For std::sort and std::max
+#include <mutex>             // For std::mutex
+#include <atomic>            // For the counters
+#include <chrono>            // For the pass interval and load timing
+#include <stdexcept>         // For exception handling
+#include <cerrno>            // For errno
+#include <cstdint>           // For std::uint64_t
+#include <cstddef>           // For std::size_t
+#include <sys/stat.h>        // For mkdir
+#include <dirent.h>          // For opendir and readdir
+#include <unistd.h>          // For unlink
+
+// SpillStats reports what the spiller has done
+struct SpillStats {
+    std::uint64_t passes = 0;          // Passes run
+    std::uint64_t spills = 0;          // Version trees written to disk
+    std::uint64_t spilled_bytes = 0;   // ... and the memory they held
+    std::uint64_t loads = 0;           // Version trees read back
+    std::uint64_t load_us = 0;         // Time spent reading them back
+    std::uint64_t max_load_us = 0;     // Longest read back
+    std::size_t spilled_files = 0;     // Files on disk after the last pass
+    std::size_t resident_files = 0;    // Files in memory after the last pass
+    std::size_t resident_bytes = 0;    // Memory held by their version trees
+};
+
+// Spiller keeps the version trees of cold files on disk. Each pass estimates the memory
+// each in-memory tree holds (stored content bytes plus its nodes); while the total exceeds
+// the budget, the trees of the files used least recently are written out, one file in the
+// checkpoint format each, and freed. "Used" is the later of the file's last modification
+// (the key RECENT_FILES ranks by) and the last command that looked it up.
+// A spilled File stays in the table as a stub that keeps its name, handle, version count
+// and modification time, so lookups and the rankings never need the tree. The first command
+// that looks the file up reads the tree back (use() is the file table's loader); contents
+// then stay mapped from the spill file until they are replaced.
+// A file is spilled under its own lock, so only commands on that file wait for the write.
+// A background thread runs a pass every interval; run_pass() can also be called directly.
+class Spiller {
+private:
+    ShardedFileTable& table;
+    RwLock& state_lock;         // Held shared while spilling a file (checkpoints hold it exclusively)
+    std::string dir;            // Where spill files go
+    std::size_t budget;         // Target for the memory of in-memory version trees
+    std::chrono::milliseconds interval;
+
+    std::mutex pass_lock;       // Serializes passes (background and on demand)
+
+    std::atomic<std::uint64_t> passes, spills, spilled_bytes, loads, load_us, max_load_us;
+    std::atomic<std::size_t> spilled_files, resident_files, resident;
+    PeriodicWorker worker;      // Runs passes in the background once started
+
+    // One in-memory file that may be spilled
+    struct Candidate {
+        std::string file;
+        Clock::time_point used;
+        std::size_t bytes;
+    };
+
+    // Returns when f was last used
+    static Clock::time_point last_use(const File* f) {
+        return std::max(f -> get_last_used(), f -> get_last_modified());
+    }
+
+    // Returns the memory held by f's version tree
+    static std::size_t footprint(const File* f) {
+        MemoryStats m = f -> Memory_Usage();
+        return m.allocated_bytes + m.versions * sizeof(TreeNode);
+    }
+
+    // Removes spill files left by an earlier run; their trees are gone with it
+    void remove_stale() {
+        DIR* d = ::opendir(dir.c_str());
+        if (!d) throw_errno("Cannot open " + dir);
+        while (struct dirent* e = ::readdir(d)) {
+            std::string name = e -> d_name;
+            if (name.size() > 6 && name.compare(name.size() - 6, 6, ".spill") == 0) ::unlink((dir + "/" + name).c_str());
+        }
+        ::closedir(d);
+    }
+
+    // Writes f's version tree to its spill file and frees it; the caller holds f's lock
+    void spill(File* f) {
+        std::string path = dir + "/" + std::to_string(f -> get_handle()) + ".spill"; // Handles are unique among live files
+        CheckpointIO io;
+        io.add_file(*f);
+        io.write(path, 0, false); // Not synced: after a crash only the WAL and checkpoint count
+        f -> Spill(path);
+    }
+
+public:
+    // Creates the spill directory if needed and empties it of earlier spill files
+    Spiller(ShardedFileTable& files, RwLock& state, const std::string& directory, std::size_t budget_bytes,
+            std::chrono::milliseconds every = std::chrono::milliseconds(1000))
+        : table(files), state_lock(state), dir(directory), budget(budget_bytes), interval(every),
+          passes(0), spills(0), spilled_bytes(0), loads(0), load_us(0), max_load_us(0),
+          spilled_files(0), resident_files(0), resident(0), worker("spilling", [this] {run_pass();}) {
+        if (::mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) throw_errno("Cannot create " + dir);
+        remove_stale();
+    }
+
+    ~Spiller() {stop();}
+
+    Spiller(const Spiller&) = delete;
+    Spiller& operator=(const Spiller&) = delete;
+
+    // Starts the background thread
+    void start() {worker.start(interval);}
+
+    // Stops the background thread, waiting for a running pass to finish
+    void stop() {worker.stop();}
+
+    // Reads the version tree of spilled f into a detached copy without taking it back, for
+    // commands that only look at the versions (see SEARCH); the caller holds f's lock
+    static std::unique_ptr<File> read_back(const File& f) {
+        std::unique_ptr<File> loaded;
+        std::uint64_t lsn;
+        CheckpointIO::load(f.get_spill_path(), lsn, [&](File* g) {loaded.reset(g);}, true);
+        if (!loaded || loaded -> get_filename() != f.get_filename()) {
+            throw std::runtime_error("Cannot read back spilled file '" + f.get_filename() + "'");
+        }
+        return loaded;
+    }
+
+    // Records that a command uses f and reads its tree back if it was spilled; the caller
+    // holds f's lock
+    void use(File* f) {
+        f -> Use();
+        if (!f -> Is_Spilled()) return;
+        auto start = std::chrono::steady_clock::now();
+        std::unique_ptr<File> loaded = read_back(*f);
+        f -> Unspill(*loaded);
+        std::uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+        loads++;
+        load_us += us;
+        std::uint64_t prev = max_load_us.load();
+        while (us > prev && !max_load_us.compare_exchange_weak(prev, us)) {}
+    }
+
+    // Spills the least recently used trees until the in-memory ones fit the budget.
+    // A file used after it was measured, or held by a transaction, is skipped.
+    void run_pass() {
+        std::lock_guard<std::mutex> pass_guard(pass_lock);
+        passes++;
+
+        std::vector<Candidate> candidates;
+        std::size_t total = 0, on_disk = 0;
+        for (const std::string& name : table.keys()) {
+            SharedLock shared(state_lock);
+            LockedFile f(table, name, false, true);
+            if (!f) continue;
+            if (f -> Is_Spilled()) {on_disk++; continue;}
+            candidates.push_back(Candidate{name, last_use(f.get()), footprint(f.get())});
+            total += candidates.back().bytes;
+        }
+
+        // Least recently used first
+        std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+            return a.used < b.used;
+        });
+
+        std::size_t in_memory = candidates.size();
+        for (const Candidate& c : candidates) {
+            if (total <= budget) break;
+            SharedLock shared(state_lock);
+            LockedFile f(table, c.file, false, true);
+            if (!f || f -> Is_Spilled() || last_use(f.get()) != c.used) continue; // Gone or used since
+            spill(f.get());
+            total -= c.bytes;
+            on_disk++;
+            in_memory--;
+            spills++;
+            spilled_bytes += c.bytes;
+        }
+        spilled_files = on_disk;
+        resident_files = in_memory;
+        resident = total;
+    }
+
+    // Returns the counters
+    SpillStats stats() const {
+        SpillStats st;
+        st.passes = passes;
+        st.spills = spills;
+        st.spilled_bytes = spilled_bytes;
+        st.loads = loads;
+        st.load_us = load_us;
+        st.max_load_us = max_load_us;
+        st.spilled_files = spilled_files;
+        st.resident_files = resident_files;
+        st.resident_bytes = resident;
+        return st;
+    }
+
+    // Returns the budget for in-memory version trees
+    std::size_t get_budget() const {return budget;}
+};
+
+#endif // End of include guard
@@ -0,0 +1,286 @@
+// stats.hpp
+#ifndef STATS_HPP // Prevents multiple inclusion of this header file
+#define STATS_HPP
+
+#include "periodic.hpp"      // PeriodicWorker, which runs the dump
+#include <vector>            // For std::vector
+#include <string>            // For std::string
+#include <mutex>             // For std::mutex
+#include <atomic>            // For the per-thread counters
+#include <chrono>            // For command timing and the dump interval
+#include <ostream>           // For std::ostream
+#include <fstream>           // For appending dumps to a file
+#include <iostream>          // For std::cerr
+#include <algorithm>         // For std::find
+#include <cstdint>           // For std::uint64_t
+#include <cstddef>           // For std::size_t
+
+// StatsSnapshot holds every counter summed over all threads. Counters live in one flat
+// array; the slot helpers of Stats give their positions.
+struct StatsSnapshot {
+    std::vector<std::uint64_t> v;
+    double seconds = 0; // Time covered, since startup or the last reset
+
+    // Returns the number of commands recorded with id c
+    std::uint64_t count(int c) const;
+    // Returns the latency below which fraction q of command c's runs fall, in ns (bucket upper bound)
+    std::uint64_t percentile_ns(int c, double q) const;
+    // Returns the mean latency of command c in ns
+    double mean_ns(int c) const;
+    // Summarizes a depth histogram starting at slot base: entries, mean depth and largest depth
+    void depths(std::size_t base, std::uint64_t& n, double& mean, int& max) const;
+};
+
+// Stats collects hot-path instrumentation: per-command latency histograms, the bytes
+// INSERT and UPDATE copy into versions, how many levels deep each ranking insertion goes and
+// how many slots past its home each file-table lookup probes. Every thread records into its
+// own counters with relaxed loads and stores (no read-modify-write, no locks); reports sum
+// all threads, and a thread's counters are folded into a shared total when it exits.
+// Resetting takes a baseline that later reports subtract, so no thread ever writes another
+// thread's counters.
+// Latencies go into log-linear buckets in the style of HdrHistogram: each power of two is
+// split into SUB linear buckets, so a bucket is at most 1/SUB (12.5%) wide relative to its
+// values, from 1 ns up to about a minute.
+// Building with -DNO_STATS makes the recording functions empty and the command timer an
+// empty object, so instrumentation compiles away entirely.
+class Stats {
+public:
+    static constexpr int MAX_COMMANDS = 32;   // Command ids recorded
+    static constexpr int SUB_BITS = 3;
+    static constexpr int SUB = 1 << SUB_BITS; // Linear buckets per power of two
+    static constexpr int MAX_BITS = 36;       // Latencies of 2^36 ns (~69 s) and more share the last bucket
+    static constexpr int LATENCY_BUCKETS = (MAX_BITS - SUB_BITS + 1) * SUB;
+    static constexpr int DEPTH_BUCKETS = 32;  // Ranking depths and probe lengths; the last bucket is "31 or more"
+
+    // Kinds of content copy
+    enum CopyKind {COPY_INSERT, COPY_UPDATE};
+
+    // Slot positions in the flat counter array
+    static constexpr std::size_t LATENCY = 0;                                         // [command][bucket]
+    static constexpr std::size_t LATENCY_NS = LATENCY + MAX_COMMANDS * LATENCY_BUCKETS; // [command] total ns
+    static constexpr std::size_t COPIES = LATENCY_NS + MAX_COMMANDS;                  // [kind] calls
+    static constexpr std::size_t COPIED_BYTES = COPIES + 2;                           // [kind] bytes
+    static constexpr std::size_t RANK_DEPTHS = COPIED_BYTES + 2;                      // [levels below the root]
+    static constexpr std::size_t PROBES = RANK_DEPTHS + DEPTH_BUCKETS;                // [slots past home]
+    static constexpr std::size_t SLOTS = PROBES + DEPTH_BUCKETS;
+
+#ifdef NO_STATS
+    static constexpr bool ENABLED = false;
+#else
+    static constexpr bool ENABLED = true;
+#endif
+
+    // Returns the latency bucket of a value in ns
+    static int bucket(std::uint64_t ns) {
+        if (ns < static_cast<std::uint64_t>(SUB)) return static_cast<int>(ns);
+        int top = 63 - __builtin_clzll(ns);
+        int shift = top - SUB_BITS;
+        int b = (shift + 1) * SUB + static_cast<int>((ns >> shift) - SUB);
+        return b < LATENCY_BUCKETS ? b : LATENCY_BUCKETS - 1;
+    }
+    // Returns the smallest value in ns that falls into bucket b
+    static std::uint64_t bucket_floor(int b) {
+        if (b < 2 * SUB) return b;
+        int shift = b / SUB - 1;
+        return static_cast<std::uint64_t>(SUB + b % SUB) << shift;
+    }
+
+private:
+    // Counters of one thread, written only by that thread
+    struct Counters {
+        std::atomic<std::uint64_t> slot[SLOTS];
+    };
+
+    // Enlists the calling thread's counters and retires them when the thread exits
+    struct Local {
+        Counters* counters;
+        Local() : counters(new Counters()) {instance().enlist(counters);}
+        ~Local() {instance().retire(counters);}
+    };
+
+    std::mutex lock;                    // Guards the fields below
+    std::vector<Counters*> live;        // Counters of running threads
+    std::vector<std::uint64_t> retired; // Sums of exited threads
+    std::vector<std::uint64_t> baseline; // Totals at the last reset
+    std::chrono::steady_clock::time_point since;
+
+    Stats() : retired(SLOTS, 0), baseline(SLOTS, 0), since(std::chrono::steady_clock::now()) {}
+
+    void enlist(Counters* c) {
+        std::lock_guard<std::mutex> guard(lock);
+        live.push_back(c);
+    }
+    void retire(Counters* c) {
+        std::lock_guard<std::mutex> guard(lock);
+        for (std::size_t i = 0; i < SLOTS; i++) retired[i] += c -> slot[i].load(std::memory_order_relaxed);
+        live.erase(std::find(live.begin(), live.end(), c));
+        delete c;
+    }
+
+    // Returns the calling thread's counters
+    static Counters& local() {
+        static thread_local Local l;
+        return *l.counters;
+    }
+
+    // Adds d to a counter of the calling thread
+    static void add(std::size_t i, std::uint64_t d) {
+        std::atomic<std::uint64_t>& s = local().slot[i];
+        s.store(s.load(std::memory_order_relaxed) + d, std::memory_order_relaxed);
+    }
+
+    // Returns every counter summed over all threads; the caller holds lock
+    std::vector<std::uint64_t> totals() const {
+        std::vector<std::uint64_t> t(retired);
+        for (const Counters* c : live) {
+            for (std::size_t i = 0; i < SLOTS; i++) t[i] += c -> slot[i].load(std::memory_order_relaxed);
+        }
+        return t;
+    }
+
+public:
+    Stats(const Stats&) = delete;
+    Stats& operator=(const Stats&) = delete;
+
+    static Stats& instance() {
+        static Stats stats;
+        return stats;
+    }
+
+#ifdef NO_STATS
+    static void command(int, std::uint64_t) {}
+    static void copied(CopyKind, std::size_t) {}
+    static void ranked(int) {}
+    static void probed(std::size_t) {}
+#else
+    // Records that command c took ns nanoseconds
+    static void command(int c, std::uint64_t ns) {
+        add(LATENCY + c * LATENCY_BUCKETS + bucket(ns), 1);
+        add(LATENCY_NS + c, ns);
+    }
+    // Records content copied into a version
+    static void copied(CopyKind kind, std::size_t bytes) {
+        add(COPIES + kind, 1);
+        add(COPIED_BYTES + kind, bytes);
+    }
+    // Records a ranking insertion that placed a file the given number of levels below the root
+    static void ranked(int levels) {
+        add(RANK_DEPTHS + (levels < DEPTH_BUCKETS ? levels : DEPTH_BUCKETS - 1), 1);
+    }
+    // Records a hash-table lookup that probed the given number of slots past the home slot
+    static void probed(std::size_t slots) {
+        add(PROBES + (slots < static_cast<std::size_t>(DEPTH_BUCKETS) ? slots : DEPTH_BUCKETS - 1), 1);
+    }
+#endif
+
+    // Returns the counters since startup or the last reset
+    StatsSnapshot snapshot() {
+        std::lock_guard<std::mutex> guard(lock);
+        StatsSnapshot s;
+        s.v = totals();
+        for (std::size_t i = 0; i < SLOTS; i++) s.v[i] -= baseline[i];
+        s.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - since).count();
+        return s;
+    }
+
+    // Starts counting from zero
+    void reset() {
+        std::lock_guard<std::mutex> guard(lock);
+        baseline = totals();
+        since = std::chrono::steady_clock::now();
+    }
+
+    // CommandTimer records the time from its construction to its destruction as one run of
+    // a command
+    class CommandTimer {
+#ifndef NO_STATS
+    private:
+        int id;
+        std::chrono::steady_clock::time_point start;
+    public:
+        explicit CommandTimer(int c) : id(c), start(std::chrono::steady_clock::now()) {}
+        ~CommandTimer() {
+            command(id, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+        }
+#else
+    public:
+        explicit CommandTimer(int) {}
+#endif
+        CommandTimer(const CommandTimer&) = delete;
+        CommandTimer& operator=(const CommandTimer&) = delete;
+    };
+};
+
+inline std::uint64_t StatsSnapshot::count(int c) const {
+    std::uint64_t n = 0;
+    for (int b = 0; b < Stats::LATENCY_BUCKETS; b++) n += v[Stats::LATENCY + c * Stats::LATENCY_BUCKETS + b];
+    return n;
+}
+
+inline std::uint64_t StatsSnapshot::percentile_ns(int c, double q) const {
+    std::uint64_t n = count(c);
+    if (n == 0) return 0;
+    std::uint64_t rank = static_cast<std::uint64_t>(q * n);
+    if (rank >= n) rank = n - 1;
+    std::uint64_t seen = 0;
+    for (int b = 0; b < Stats::LATENCY_BUCKETS; b++) {
+        seen += v[Stats::LATENCY + c * Stats::LATENCY_BUCKETS + b];
+        if (seen > rank) return b + 1 < Stats::LATENCY_BUCKETS ? Stats::bucket_floor(b + 1) - 1 : Stats::bucket_floor(b);
+    }
+    return 0;
+}
+
+inline double StatsSnapshot::mean_ns(int c) const {
+    std::uint64_t n = count(c);
+    return n ? static_cast<double>(v[Stats::LATENCY_NS + c]) / n : 0.0;
+}
+
+inline void StatsSnapshot::depths(std::size_t base, std::uint64_t& n, double& mean, int& max) const {
+    std::uint64_t sum = 0;
+    n = 0;
+    max = 0;
+    for (int d = 0; d < Stats::DEPTH_BUCKETS; d++) {
+        std::uint64_t k = v[base + d];
+        if (!k) continue;
+        n += k;
+        sum += k * d;
+        max = d;
+    }
+    mean = n ? static_cast<double>(sum) / n : 0.0;
+}
+
+// StatsDumper writes a report every interval, appending to a file or to stderr. The
+// report itself is produced by a writer function (see write_stats_json in commands.hpp).
+class StatsDumper {
+public:
+    typedef void (*Writer)(std::ostream& out);
+
+private:
+    Writer writer;
+    std::string path;           // Empty for stderr
+    PeriodicWorker worker;
+
+    void dump() {
+        if (path.empty()) {
+            writer(std::cerr);
+            return;
+        }
+        std::ofstream out(path.c_str(), std::ios::app);
+        writer(out);
+        if (!out) std::cerr << "Error: could not write statistics to '" << path << "'" << std::endl;
+    }
+
+public:
+    StatsDumper(Writer w, const std::string& file, std::chrono::milliseconds every)
+        : writer(w), path(file), worker("statistics dump", [this] {dump();}) {
+        worker.start(every);
+    }
+
+    // Stops the thread, waiting for a running dump to finish
+    ~StatsDumper() {worker.stop();}
+
+    StatsDumper(const StatsDumper&) = delete;
+    StatsDumper& operator=(const StatsDumper&) = delete;
+};
+
+#endif // End of include guard
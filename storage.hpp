@@ -0,0 +1,420 @@
+// storage.hpp
+#ifndef STORAGE_HPP // Prevents multiple inclusion of this header file
+#define STORAGE_HPP
+
+#include "file.hpp"        // Includes File and TreeNode definitions
+#include "checkpoint.hpp"  // Includes CheckpointIO and the IO helpers
+#include <string>          // For std::string
+#include <vector>          // For std::vector
+#include <chrono>          // For group-commit timing
+#include <mutex>           // For std::mutex
+#include <condition_variable> // For waking the flusher and the commands waiting for it
+#include <thread>          // For the flusher thread
+#include <algorithm>       // For std::max
+#include <cstdint>         // For fixed-width integers
+#include <cstring>         // For std::memcpy and std::strerror
+#include <cerrno>          // For errno
+#include <cstdio>          // For std::rename
+#include <stdexcept>       // For exception handling
+#include <fcntl.h>         // For open
+#include <unistd.h>        // For write, fsync, ftruncate and close
+#include <sys/stat.h>      // For mkdir and fstat
+
+// Operation codes of WAL records (one per mutating command)
+enum WalOp : std::uint8_t {
+    WAL_CREATE = 1,
+    WAL_INSERT = 2,
+    WAL_UPDATE = 3,
+    WAL_SNAPSHOT = 4,
+    WAL_ROLLBACK = 5,
+    WAL_DELETE = 6,
+    WAL_GC = 7,
+    WAL_CLONE = 8,          // Clone (arg: the versions it starts with, see encode_clone in commands.hpp)
+    WAL_BATCH = 9,          // Records of one transaction (arg: the records, see Storage::log_batch)
+    WAL_MERGE = 10          // Merge into a version (arg: second parent ID, a space, the merged content)
+};
+
+// WalRecord describes one logged mutation
+struct WalRecord {
+    std::uint64_t lsn;     // Log sequence number, assigned by Storage::log
+    WalOp op;              // Operation
+    std::int64_t time;     // Clock value the command ran with (microseconds)
+    std::string file;      // Target file name
+    std::string arg;       // Content (INSERT/UPDATE), message (SNAPSHOT), removed version IDs (GC), cloned versions (CLONE), records (BATCH) or second parent and content (MERGE)
+    std::int32_t version;  // Target version (ROLLBACK) or first parent (MERGE), -1 otherwise
+};
+
+// StorageOptions configures durable mode
+struct StorageOptions {
+    std::string dir;                   // Data directory holding the WAL and the checkpoint
+    int sync_every = 64;               // fsync once this many records are unsynced (1 = every record)
+    int sync_ms = 10;                  // ... or once the oldest unsynced record is this old, or as
+                                       // soon as a command waits for its records (see wait_synced)
+    std::uint64_t checkpoint_every = 100000; // Take a checkpoint after this many WAL records (0 = never)
+};
+
+// RecoveryStats reports what startup recovery did
+struct RecoveryStats {
+    std::size_t files_loaded = 0;      // Files restored from the checkpoint
+    std::size_t records_replayed = 0;  // WAL records applied on top of it
+    std::size_t records_skipped = 0;   // WAL records already covered by the checkpoint
+    bool torn_tail = false;            // A partial or corrupt record ended the WAL
+};
+
+// ---------------- ENCODING HELPERS ----------------
+
+// Appends fixed-width little-endian integers and length-prefixed strings to a buffer
+struct Encoder {
+    std::string buf; // Encoded bytes
+
+    template <typename T>
+    void put(T v) {
+        char b[sizeof(T)];
+        std::memcpy(b, &v, sizeof(T)); // Host order; checkpoints are not meant to move between architectures
+        buf.append(b, sizeof(T));
+    }
+    void put_str(const std::string& s) {
+        put<std::uint32_t>(s.size());
+        buf.append(s);
+    }
+};
+
+// Reads values written by Encoder, throwing on truncated input
+struct Decoder {
+    const char* p;   // Current read position
+    const char* end; // End of input
+
+    Decoder(const char* begin, const char* finish) : p(begin), end(finish) {}
+
+    template <typename T>
+    T get() {
+        if (static_cast<std::size_t>(end - p) < sizeof(T)) throw std::runtime_error("Truncated record");
+        T v;
+        std::memcpy(&v, p, sizeof(T));
+        p += sizeof(T);
+        return v;
+    }
+    std::string get_str() {
+        std::uint32_t n = get<std::uint32_t>();
+        if (static_cast<std::size_t>(end - p) < n) throw std::runtime_error("Truncated record");
+        std::string s(p, n);
+        p += n;
+        return s;
+    }
+};
+
+// Reads a whole file into a string; returns false if it does not exist
+inline bool read_whole_file(const std::string& path, std::string& out) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        if (errno == ENOENT) return false;
+        throw_errno("Cannot open " + path);
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {::close(fd); throw_errno("Cannot stat " + path);}
+    out.resize(st.st_size);
+    std::size_t got = 0;
+    while (got < out.size()) {
+        ssize_t r = ::read(fd, &out[got], out.size() - got);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            ::close(fd);
+            throw_errno("Cannot read " + path);
+        }
+        if (r == 0) break;
+        got += r;
+    }
+    out.resize(got);
+    ::close(fd);
+    return true;
+}
+
+// ---------------- DURABLE STORAGE ----------------
+
+// Storage implements durable mode: every mutation is appended to a write-ahead log with
+// batched fsyncs (group commit), and periodic checkpoints hold the whole state so that
+// startup only loads the checkpoint and replays the WAL tail written after it.
+//
+// Appends go to the kernel right away; a flusher thread fsyncs them. It syncs once
+// sync_every records are pending, once the oldest pending one is sync_ms old, and as soon
+// as a command waits for its records (wait_synced) if no fsync is already running.
+// Records logged while an fsync runs are covered by the next one, so concurrent commands
+// share fsyncs. Commands wait before their output is released (see await_durable in
+// commands.hpp), so a reply is never seen before what it reports is on disk.
+//
+// On-disk layout in the data directory:
+//   wal.log         sequence of [u32 length][u32 crc][payload] records
+//   checkpoint.bin  mmap-able checkpoint (see checkpoint.hpp) including its last LSN
+class Storage {
+private:
+    StorageOptions opts;
+    std::mutex lock;               // Serializes WAL appends from concurrent commands; guards the fields below
+    int wal_fd;                    // Open WAL, positioned at its end
+    std::uint64_t next_lsn;        // LSN of the next record
+    std::uint64_t unsynced;        // Records written since the last fsync started
+    std::uint64_t since_checkpoint; // Records written since the last checkpoint
+    std::chrono::steady_clock::time_point oldest_unsynced; // Write time of the oldest unsynced record
+    std::uint64_t synced_lsn;      // Every record up to this LSN is on disk
+    std::uint64_t wanted_lsn;      // Highest LSN a command waits for
+    std::string sync_error;        // Set when an fsync failed; later waits throw it
+    bool stopping;                 // Ends the flusher
+
+    std::thread flusher;
+    std::condition_variable flush_wake; // Wakes the flusher
+    std::condition_variable synced;     // Wakes commands waiting in wait_synced
+
+    // Returns the LSN of the last record the calling thread logged and has not waited for
+    static std::uint64_t& thread_lsn() {
+        static thread_local std::uint64_t lsn = 0;
+        return lsn;
+    }
+
+    std::string wal_path() const {return opts.dir + "/wal.log";}
+    std::string checkpoint_path() const {return opts.dir + "/checkpoint.bin";}
+
+    // fsyncs a directory so that renames inside it are durable
+    void sync_dir() {
+        int fd = ::open(opts.dir.c_str(), O_RDONLY);
+        if (fd < 0) throw_errno("Cannot open " + opts.dir);
+        ::fsync(fd);
+        ::close(fd);
+    }
+
+    // Opens the WAL for appending, truncated to valid_len bytes
+    void open_wal(std::size_t valid_len) {
+        wal_fd = ::open(wal_path().c_str(), O_WRONLY | O_CREAT, 0644);
+        if (wal_fd < 0) throw_errno("Cannot open " + wal_path());
+        if (::ftruncate(wal_fd, valid_len) != 0) throw_errno("Cannot truncate " + wal_path());
+        if (::lseek(wal_fd, 0, SEEK_END) < 0) throw_errno("Cannot seek " + wal_path());
+    }
+
+    // Returns true if the records written so far are due for an fsync; the caller holds lock
+    bool sync_due(std::chrono::steady_clock::time_point now) const {
+        if (next_lsn - 1 <= synced_lsn) return false;
+        return wanted_lsn > synced_lsn || unsynced >= static_cast<std::uint64_t>(opts.sync_every) ||
+               now - oldest_unsynced >= std::chrono::milliseconds(opts.sync_ms);
+    }
+
+    // Runs on the flusher thread: fsyncs the WAL whenever sync_due, without holding lock
+    // while the fsync runs so that commands keep appending. Stops at the first failed fsync.
+    void flush_loop() {
+        std::unique_lock<std::mutex> guard(lock);
+        while (!stopping) {
+            if (!sync_due(std::chrono::steady_clock::now())) {
+                if (next_lsn - 1 > synced_lsn && unsynced > 0) flush_wake.wait_until(guard, oldest_unsynced + std::chrono::milliseconds(opts.sync_ms));
+                else flush_wake.wait(guard);
+                continue;
+            }
+            std::uint64_t target = next_lsn - 1;
+            unsynced = 0;
+            guard.unlock();
+            int rc = ::fdatasync(wal_fd); // wal_fd stays open until the flusher is stopped
+            int err = errno;
+            guard.lock();
+            if (rc != 0) { // Not retried: the kernel may have dropped the pages that failed
+                sync_error = "Cannot sync " + wal_path() + ": " + std::strerror(err);
+                synced.notify_all();
+                break;
+            }
+            synced_lsn = std::max(synced_lsn, target);
+            synced.notify_all();
+        }
+    }
+
+public:
+    // Constructor: creates the data directory if needed; call recover() before logging
+    explicit Storage(const StorageOptions& options)
+        : opts(options), wal_fd(-1), next_lsn(1), unsynced(0), since_checkpoint(0), synced_lsn(0), wanted_lsn(0),
+          stopping(false) {
+        if (opts.dir.empty()) throw std::invalid_argument("Data directory must not be empty");
+        if (opts.sync_every < 1) opts.sync_every = 1;
+        if (::mkdir(opts.dir.c_str(), 0755) != 0 && errno != EEXIST) throw_errno("Cannot create " + opts.dir);
+    }
+
+    // Destructor: stops the flusher and makes every logged record durable
+    ~Storage() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        flush_wake.notify_all();
+        if (flusher.joinable()) flusher.join();
+        if (wal_fd >= 0) {
+            if (next_lsn - 1 > synced_lsn) ::fdatasync(wal_fd);
+            ::close(wal_fd);
+        }
+    }
+
+    Storage(const Storage&) = delete;
+    Storage& operator=(const Storage&) = delete;
+
+    // Loads the checkpoint (on_file is called for every restored File*) and replays the
+    // WAL records written after it (on_record is called for each, in order)
+    template <typename OnFile, typename OnRecord>
+    RecoveryStats recover(OnFile on_file, OnRecord on_record) {
+        RecoveryStats stats;
+        std::uint64_t checkpoint_lsn = 0;
+
+        CheckpointIO::load(checkpoint_path(), checkpoint_lsn, [&](File* f) {
+            on_file(f);
+            stats.files_loaded++;
+        });
+        next_lsn = checkpoint_lsn + 1;
+
+        std::size_t valid_len = 0;
+        std::string data;
+        if (read_whole_file(wal_path(), data)) {
+            std::size_t off = 0;
+            const std::size_t header = 2 * sizeof(std::uint32_t);
+            while (off + header <= data.size()) {
+                std::uint32_t len, crc;
+                std::memcpy(&len, data.data() + off, sizeof(len));
+                std::memcpy(&crc, data.data() + off + sizeof(len), sizeof(crc));
+                if (data.size() - off - header < len || crc32(data.data() + off + header, len) != crc) break;
+                Decoder dec(data.data() + off + header, data.data() + off + header + len);
+                WalRecord r;
+                r.lsn = dec.get<std::uint64_t>();
+                r.op = static_cast<WalOp>(dec.get<std::uint8_t>());
+                r.time = Clock::from_disk(dec.get<std::int64_t>());
+                r.file = dec.get_str();
+                r.arg = dec.get_str();
+                r.version = dec.get<std::int32_t>();
+                off += header + len;
+                if (r.lsn <= checkpoint_lsn) {stats.records_skipped++; continue;} // Already in the checkpoint
+                if (r.op != WAL_BATCH) {
+                    on_record(r);
+                    stats.records_replayed++;
+                }
+                else {
+                    Decoder batch(r.arg.data(), r.arg.data() + r.arg.size());
+                    while (batch.p != batch.end) {
+                        WalRecord sub;
+                        sub.lsn = r.lsn;
+                        sub.op = static_cast<WalOp>(batch.get<std::uint8_t>());
+                        sub.time = batch.get<std::int64_t>();
+                        sub.file = batch.get_str();
+                        sub.arg = batch.get_str();
+                        sub.version = batch.get<std::int32_t>();
+                        on_record(sub);
+                        stats.records_replayed++;
+                    }
+                }
+                next_lsn = r.lsn + 1;
+            }
+            valid_len = off;
+            stats.torn_tail = off != data.size();
+        }
+        since_checkpoint = stats.records_replayed;
+        synced_lsn = wanted_lsn = next_lsn - 1; // Whatever was read back is on disk
+        open_wal(valid_len); // Drops a torn tail so new records stay reachable
+        if (!flusher.joinable()) flusher = std::thread(&Storage::flush_loop, this);
+        return stats;
+    }
+
+    // Appends a mutation to the WAL and assigns its LSN. The record reaches the kernel
+    // immediately (surviving a process crash); the flusher fsyncs it later (see the class
+    // comment), and wait_synced waits for that.
+    void log(WalRecord r) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (wal_fd < 0) throw std::logic_error("Storage::recover must run before logging");
+        r.lsn = next_lsn++;
+        Encoder payload;
+        payload.put<std::uint64_t>(r.lsn);
+        payload.put<std::uint8_t>(r.op);
+        payload.put<std::int64_t>(r.time);
+        payload.put_str(r.file);
+        payload.put_str(r.arg);
+        payload.put<std::int32_t>(r.version);
+        Encoder rec;
+        rec.put<std::uint32_t>(payload.buf.size());
+        rec.put<std::uint32_t>(crc32(payload.buf.data(), payload.buf.size()));
+        rec.buf += payload.buf;
+        write_all(wal_fd, rec.buf.data(), rec.buf.size(), wal_path());
+
+        thread_lsn() = r.lsn;
+        if (unsynced++ == 0) {
+            oldest_unsynced = std::chrono::steady_clock::now();
+            flush_wake.notify_one(); // Arms the sync_ms deadline
+        }
+        else if (unsynced == static_cast<std::uint64_t>(opts.sync_every)) flush_wake.notify_one();
+        since_checkpoint++;
+    }
+
+    // Waits until every record the calling thread logged is on disk, asking the flusher for
+    // an fsync if none covers it yet. Throws if an fsync failed.
+    void wait_synced() {
+        std::uint64_t lsn = thread_lsn();
+        if (lsn == 0) return;
+        std::unique_lock<std::mutex> guard(lock);
+        if (lsn > wanted_lsn) {
+            wanted_lsn = lsn;
+            flush_wake.notify_one();
+        }
+        synced.wait(guard, [&] {return synced_lsn >= lsn || !sync_error.empty();});
+        if (synced_lsn < lsn) throw std::runtime_error(sync_error);
+        thread_lsn() = 0;
+    }
+
+    // Appends the mutations of one transaction as a single WAL record, so that recovery
+    // replays either all of them or (after a torn write) none
+    void log_batch(const std::vector<WalRecord>& records) {
+        if (records.size() <= 1) {
+            if (!records.empty()) log(records[0]);
+            return;
+        }
+        Encoder batch;
+        for (const WalRecord& r : records) {
+            batch.put<std::uint8_t>(r.op);
+            batch.put<std::int64_t>(r.time);
+            batch.put_str(r.file);
+            batch.put_str(r.arg);
+            batch.put<std::int32_t>(r.version);
+        }
+        log(WalRecord{0, WAL_BATCH, records.back().time, "", batch.buf, -1});
+    }
+
+    // fsyncs every record logged so far
+    void sync() {
+        std::lock_guard<std::mutex> guard(lock);
+        sync_locked();
+    }
+
+private:
+    // fsyncs every record logged so far; the caller holds lock
+    void sync_locked() {
+        if (wal_fd < 0 || next_lsn - 1 <= synced_lsn) return;
+        if (::fdatasync(wal_fd) != 0) throw_errno("Cannot sync " + wal_path());
+        unsynced = 0;
+        synced_lsn = next_lsn - 1;
+        synced.notify_all();
+    }
+
+public:
+    // Returns true once enough records were logged since the last checkpoint
+    bool checkpoint_due() {
+        std::lock_guard<std::mutex> guard(lock);
+        return opts.checkpoint_every > 0 && since_checkpoint >= opts.checkpoint_every;
+    }
+
+    // Writes a checkpoint of every file in table (anything with for_each(fn)) and truncates the WAL.
+    // The checkpoint is written to a temporary file and renamed into place, so a crash at
+    // any point leaves either the old or the new checkpoint; WAL records it covers are
+    // skipped by LSN on recovery.
+    template <typename Table>
+    void checkpoint(const Table& table) {
+        std::lock_guard<std::mutex> guard(lock);
+        sync_locked();
+        CheckpointIO io;
+        table.for_each([&](const File* f) {io.add_file(*f);});
+        std::string tmp = checkpoint_path() + ".tmp";
+        io.write(tmp, next_lsn - 1);
+        if (std::rename(tmp.c_str(), checkpoint_path().c_str()) != 0) throw_errno("Cannot rename " + tmp);
+        sync_dir();
+
+        if (::ftruncate(wal_fd, 0) != 0) throw_errno("Cannot truncate " + wal_path());
+        if (::lseek(wal_fd, 0, SEEK_SET) < 0) throw_errno("Cannot seek " + wal_path());
+        since_checkpoint = 0;
+    }
+};
+
+#endif // End of include guard
@@ -0,0 +1,364 @@
+// text_index.hpp
+#ifndef TEXT_INDEX_HPP // Prevents multiple inclusion of this header file
+#define TEXT_INDEX_HPP
+
+#include "rope.hpp"        // Rope and its pieces
+#include <string>          // For std::string
+#include <vector>          // For std::vector
+#include <unordered_map>   // For posting lists and seen pieces
+#include <algorithm>       // For std::sort and std::binary_search
+#include <utility>         // For std::pair
+#include <mutex>           // For std::mutex
+#include <atomic>          // For the enabled flag and counters
+#include <cstring>         // For std::memcmp and std::memchr
+#include <cstdint>         // For std::uint32_t
+#include <cstddef>         // For std::size_t
+#if defined(__SSE2__)
+#include <emmintrin.h>     // For SSE2 byte comparisons
+#endif
+
+// Returns true if needle[0, m) occurs in hay[0, n). With SSE2, 16 candidate positions are
+// tested at once by comparing the needle's first and last bytes; only positions where
+// both match are compared in full.
+inline bool contains_bytes(const char* hay, std::size_t n, const char* needle, std::size_t m) {
+    if (m == 0) return true;
+    if (m > n) return false;
+    if (m == 1) return std::memchr(hay, needle[0], n) != nullptr;
+    std::size_t i = 0, last = n - m; // Last possible start
+#if defined(__SSE2__)
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i final_byte = _mm_set1_epi8(needle[m - 1]);
+    for (; i + 16 <= last + 1; i += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(hay + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(hay + i + m - 1));
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, final_byte)));
+        while (mask) {
+            unsigned bit = __builtin_ctz(mask);
+            if (std::memcmp(hay + i + bit + 1, needle + 1, m - 2) == 0) return true;
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for (; i <= last; i++) {
+        if (hay[i] == needle[0] && hay[i + m - 1] == needle[m - 1] && std::memcmp(hay + i + 1, needle + 1, m - 2) == 0) return true;
+    }
+    return false;
+}
+
+// Returns true if the rope's content contains the pattern
+inline bool rope_contains(const Rope& r, const std::string& pattern) {
+    const char* single = nullptr;
+    std::size_t pieces = 0, len = 0;
+    r.for_each_piece([&](const Rope::Piece& p) {single = p.data(); len = p.len; pieces++;});
+    if (pieces <= 1) return contains_bytes(single ? single : "", len, pattern.data(), pattern.size());
+    std::string flat = r.str(); // Matches may straddle pieces
+    return contains_bytes(flat.data(), flat.size(), pattern.data(), pattern.size());
+}
+
+// TrigramSet is an open-addressing set of trigram keys (24-bit values), about 6 bytes each
+class TrigramSet {
+private:
+    static constexpr std::uint32_t EMPTY = 0xFFFFFFFFu;
+    std::vector<std::uint32_t> slots;
+    std::size_t count = 0;
+    int shift = 32;       // 32 - log2(slots.size()): slots are picked by the hash's top bits
+
+    // Rehashes into a table of `capacity` slots (a power of two)
+    void rehash(std::size_t capacity) {
+        std::vector<std::uint32_t> old;
+        old.swap(slots);
+        slots.assign(capacity, std::uint32_t(EMPTY)); // Copy: EMPTY has no definition in C++11
+        shift = 32;
+        while (capacity > 1) {capacity >>= 1; shift--;}
+        count = 0;
+        for (std::uint32_t k : old) {
+            if (k != EMPTY) insert(k);
+        }
+    }
+
+public:
+    // Makes room for n keys in total without further rehashing
+    void reserve(std::size_t n) {
+        std::size_t capacity = slots.empty() ? 16 : slots.size();
+        while (n * 10 > capacity * 7) capacity *= 2;
+        if (capacity > slots.size()) rehash(capacity);
+    }
+
+    // Adds key; returns false if it was already present
+    bool insert(std::uint32_t key) {
+        if ((count + 1) * 10 > slots.size() * 7) rehash(slots.empty() ? 16 : slots.size() * 2); // Keep the load under 70%
+        std::size_t mask = slots.size() - 1;
+        for (std::size_t i = static_cast<std::uint32_t>(key * 2654435761u) >> shift;; i = (i + 1) & mask) {
+            if (slots[i] == key) return false;
+            if (slots[i] == EMPTY) {
+                slots[i] = key;
+                count++;
+                return true;
+            }
+        }
+    }
+    std::size_t size() const {return count;} // Returns the number of keys
+};
+
+// SearchDoc is one file's entry in the TextIndex
+struct SearchDoc {
+    std::uint32_t id = 0;  // Document id, 0 if the file is not indexed
+    TrigramSet trigrams;   // Trigrams already posted for this document
+};
+
+// TextIndex is an inverted index from trigrams (three consecutive bytes) to the files
+// whose content contains them. A file is one document covering all of its versions, so a
+// posting never has to be withdrawn while the file exists: INSERT only adds text, and the
+// trigrams of content replaced by UPDATE are simply kept. Postings are therefore a
+// superset, and every candidate is verified against the actual content. Deleted
+// documents are dropped from the posting lists lazily, once they make up half of them.
+// Document ids are never reused, so a posting can never point at the wrong file.
+class TextIndex {
+private:
+    // PostingList holds the ids of documents containing one trigram
+    struct PostingList {
+        std::vector<std::uint32_t> ids;
+        bool sorted = true;   // Ids are appended in any order and sorted on first query
+    };
+
+    // Shard is an independently locked part of the index: an open-addressing table from
+    // trigram to posting list, probed like TrigramSet
+    struct Shard {
+        static constexpr std::uint32_t EMPTY = 0xFFFFFFFFu;
+        std::mutex lock;
+        std::vector<std::uint32_t> keys;  // Trigram per slot, or EMPTY
+        std::vector<PostingList> lists;   // Posting list per slot
+        std::size_t count = 0;
+        int shift = 32;
+
+        // Returns the list of key, or nullptr if there is none
+        PostingList* find(std::uint32_t key) {
+            if (keys.empty()) return nullptr;
+            std::size_t mask = keys.size() - 1;
+            for (std::size_t i = static_cast<std::uint32_t>(key * 2654435761u) >> shift;; i = (i + 1) & mask) {
+                if (keys[i] == key) return &lists[i];
+                if (keys[i] == EMPTY) return nullptr;
+            }
+        }
+        // Returns the list of key, adding an empty one if needed
+        PostingList& get(std::uint32_t key) {
+            if ((count + 1) * 10 > keys.size() * 7) grow();
+            std::size_t mask = keys.size() - 1;
+            for (std::size_t i = static_cast<std::uint32_t>(key * 2654435761u) >> shift;; i = (i + 1) & mask) {
+                if (keys[i] == key) return lists[i];
+                if (keys[i] == EMPTY) {
+                    keys[i] = key;
+                    count++;
+                    return lists[i];
+                }
+            }
+        }
+        void grow() {
+            std::vector<std::uint32_t> old_keys(keys.empty() ? 256 : keys.size() * 2, std::uint32_t(EMPTY));
+            std::vector<PostingList> old_lists(old_keys.size());
+            old_keys.swap(keys);
+            old_lists.swap(lists);
+            shift = 32;
+            for (std::size_t c = keys.size(); c > 1; c >>= 1) shift--;
+            count = 0;
+            for (std::size_t i = 0; i < old_keys.size(); i++) {
+                if (old_keys[i] != EMPTY) get(old_keys[i]) = std::move(old_lists[i]);
+            }
+        }
+    };
+
+    static constexpr std::size_t SHARDS = 64;
+    Shard shards[SHARDS];
+    std::atomic<bool> on;
+    std::mutex names_lock;
+    std::mutex purge_lock;          // Held by the one thread purging at a time
+    std::vector<std::string> names; // Document id -> file name ("" once deleted); guarded by names_lock
+    std::atomic<std::size_t> postings;      // Postings in all lists
+    std::atomic<std::size_t> dead_postings; // ... of which belong to deleted documents
+
+    static std::size_t shard_of(std::uint32_t key) {return (key * 0x85EBCA6Bu) >> 26;} // Independent of the slot hash
+
+    // Calls fn(key) for every trigram ending in p[0, n), given the `have` bytes before it in window
+    template <typename Fn>
+    static void scan(std::uint32_t& window, int& have, const char* p, std::size_t n, Fn fn) {
+        for (std::size_t i = 0; i < n; i++) {
+            window = ((window << 8) | static_cast<unsigned char>(p[i])) & 0xFFFFFFu;
+            if (have < 3) have++;
+            if (have == 3) fn(window);
+        }
+    }
+
+    // Posts doc to the lists of the given trigrams (new to the document)
+    void post(std::uint32_t id, const std::vector<std::uint32_t>& keys) {
+        if (keys.empty()) return;
+        std::size_t start[SHARDS + 1] = {}; // Counting sort by shard: one lock per shard touched
+        for (std::uint32_t key : keys) start[shard_of(key) + 1]++;
+        for (std::size_t s = 0; s < SHARDS; s++) start[s + 1] += start[s];
+        std::vector<std::uint32_t> grouped(keys.size());
+        std::size_t fill[SHARDS];
+        std::copy(start, start + SHARDS, fill);
+        for (std::uint32_t key : keys) grouped[fill[shard_of(key)]++] = key;
+        for (std::size_t s = 0; s < SHARDS; s++) {
+            if (start[s] == start[s + 1]) continue;
+            Shard& sh = shards[s];
+            std::lock_guard<std::mutex> guard(sh.lock);
+            for (std::size_t i = start[s]; i < start[s + 1]; i++) {
+                PostingList& list = sh.get(grouped[i]);
+                if (!list.ids.empty() && list.ids.back() > id) list.sorted = false;
+                list.ids.push_back(id);
+            }
+        }
+        postings += keys.size();
+    }
+
+    // Removes the postings of deleted documents from every list
+    void purge() {
+        std::vector<bool> alive;
+        {
+            std::lock_guard<std::mutex> guard(names_lock);
+            alive.resize(names.size());
+            for (std::size_t i = 0; i < names.size(); i++) alive[i] = !names[i].empty();
+        }
+        std::size_t removed = 0;
+        for (Shard& sh : shards) {
+            std::lock_guard<std::mutex> guard(sh.lock);
+            for (PostingList& list : sh.lists) { // Emptied lists keep their slot
+                std::size_t before = list.ids.size();
+                list.ids.erase(std::remove_if(list.ids.begin(), list.ids.end(), [&](std::uint32_t id) {return id < alive.size() && !alive[id];}), list.ids.end());
+                removed += before - list.ids.size();
+            }
+        }
+        postings -= removed;
+        dead_postings -= removed;
+    }
+
+public:
+    TextIndex() : on(false), names(1), postings(0), dead_postings(0) {}
+
+    TextIndex(const TextIndex&) = delete;
+    TextIndex& operator=(const TextIndex&) = delete;
+
+    // Returns the process-wide index
+    static TextIndex& instance() {
+        static TextIndex index;
+        return index;
+    }
+
+    // Turns indexing on; files created earlier stay unindexed
+    void enable() {on = true;}
+    // Returns true if files are being indexed
+    bool enabled() const {return on;}
+
+    // Registers a new file; returns its document id, or 0 if indexing is off
+    std::uint32_t add_document(const std::string& name) {
+        if (!on) return 0;
+        std::lock_guard<std::mutex> guard(names_lock);
+        names.push_back(name);
+        return static_cast<std::uint32_t>(names.size() - 1);
+    }
+
+    // Forgets a deleted file. Its postings are dropped later, in bulk.
+    void remove_document(SearchDoc& doc) {
+        if (!doc.id) return;
+        {
+            std::lock_guard<std::mutex> guard(names_lock);
+            names[doc.id].clear();
+            names[doc.id].shrink_to_fit();
+        }
+        doc.id = 0;
+        std::size_t dead = dead_postings += doc.trigrams.size();
+        if (dead > 4096 && dead * 2 > postings && purge_lock.try_lock()) {
+            std::lock_guard<std::mutex> guard(purge_lock, std::adopt_lock);
+            purge();
+        }
+    }
+
+    // Indexes text appended after `prefix` (the up to two bytes that precede it)
+    void add_text(SearchDoc& doc, const char* prefix, std::size_t prefix_len, const char* p, std::size_t n) {
+        if (!doc.id) return;
+        std::uint32_t window = 0;
+        int have = 0;
+        std::vector<std::uint32_t> fresh;
+        fresh.reserve(n);
+        doc.trigrams.reserve(doc.trigrams.size() + (n < 4096 ? n : 4096));
+        scan(window, have, prefix, prefix_len, [](std::uint32_t) {});
+        scan(window, have, p, n, [&](std::uint32_t key) {if (doc.trigrams.insert(key)) fresh.push_back(key);});
+        post(doc.id, fresh);
+    }
+
+    // Indexes a whole rope. Pieces already indexed for this document (as recorded in seen:
+    // start -> longest length) only contribute the trigrams that cross their edges, so the
+    // versions of a restored file, which share most pieces, are read about once.
+    void add_rope(SearchDoc& doc, const Rope& r, std::unordered_map<const char*, std::size_t>& seen) {
+        if (!doc.id) return;
+        std::uint32_t window = 0;
+        int have = 0;
+        std::vector<std::uint32_t> fresh;
+        auto add = [&](std::uint32_t key) {if (doc.trigrams.insert(key)) fresh.push_back(key);};
+        r.for_each_piece([&](const Rope::Piece& piece) {
+            const char* p = piece.data();
+            std::size_t& done = seen[p];
+            if (piece.len <= done || piece.len <= 2) {
+                std::size_t head = piece.len < 2 ? piece.len : 2;
+                scan(window, have, p, head, add);
+                if (piece.len > head) { // Skip to the last two bytes
+                    window = (static_cast<unsigned char>(p[piece.len - 2]) << 8) | static_cast<unsigned char>(p[piece.len - 1]);
+                    have = 2;
+                }
+            }
+            else scan(window, have, p, piece.len, add);
+            if (piece.len > done) done = piece.len;
+        });
+        post(doc.id, fresh);
+    }
+
+    // Returns (id, name) of every live document that may contain pattern, which must be
+    // at least three bytes long. Lists are intersected starting from the shortest.
+    std::vector<std::pair<std::uint32_t, std::string>> candidates(const std::string& pattern) {
+        std::vector<std::uint32_t> keys;
+        std::uint32_t window = 0;
+        int have = 0;
+        scan(window, have, pattern.data(), pattern.size(), [&](std::uint32_t key) {keys.push_back(key);});
+        std::sort(keys.begin(), keys.end());
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+        std::vector<std::pair<std::size_t, std::uint32_t>> by_size; // Posting count, trigram
+        for (std::uint32_t key : keys) {
+            Shard& sh = shards[shard_of(key)];
+            std::lock_guard<std::mutex> guard(sh.lock);
+            PostingList* list = sh.find(key);
+            if (!list || list -> ids.empty()) return {};
+            by_size.emplace_back(list -> ids.size(), key);
+        }
+        std::sort(by_size.begin(), by_size.end());
+
+        std::vector<std::uint32_t> ids;
+        for (std::size_t i = 0; i < by_size.size(); i++) {
+            Shard& sh = shards[shard_of(by_size[i].second)];
+            std::lock_guard<std::mutex> guard(sh.lock);
+            PostingList* found = sh.find(by_size[i].second);
+            if (!found) return {};
+            PostingList& list = *found;
+            if (!list.sorted) {
+                std::sort(list.ids.begin(), list.ids.end());
+                list.sorted = true;
+            }
+            if (i == 0) ids = list.ids;
+            else {
+                ids.erase(std::remove_if(ids.begin(), ids.end(), [&](std::uint32_t id) {
+                    return !std::binary_search(list.ids.begin(), list.ids.end(), id);
+                }), ids.end());
+            }
+            if (ids.empty()) return {};
+        }
+
+        std::vector<std::pair<std::uint32_t, std::string>> result;
+        std::lock_guard<std::mutex> guard(names_lock);
+        for (std::uint32_t id : ids) {
+            if (id < names.size() && !names[id].empty()) result.emplace_back(id, names[id]);
+        }
+        return result;
+    }
+};
+
+#endif // End of include guard
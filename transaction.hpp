@@ -0,0 +1,171 @@
+// transaction.hpp
+#ifndef TRANSACTION_HPP // Prevents multiple inclusion of this header file
+#define TRANSACTION_HPP
+
+#include "file_hash.hpp"   // ShardedFileTable and File
+#include "storage.hpp"     // WalRecord
+#include <string>          // For std::string
+#include <vector>          // For std::vector
+#include <unordered_set>   // For the files whose rankings are stale
+#include <unordered_map>   // For finding a file's mark
+#include <mutex>           // For std::lock_guard
+#include <cstddef>         // For std::size_t
+
+// Transaction groups the commands between BEGIN and COMMIT. Each command is applied when
+// it arrives; while it runs, the transaction is the current one of the thread (see Scope)
+// and collects:
+//   - an undo log: a FileMark for every file changed, and the files created and deleted
+//     (deleted files stay in the table as tombstones until the outcome is known);
+//   - the WAL records, written as one record on commit (see Storage::log_batch);
+//   - the files whose RECENT_FILES/BIGGEST_TREES keys changed, whose rankings are then
+//     refreshed once each instead of after every mutation.
+// Every file changed, created or deleted is held (see FileHolder) until the transaction
+// commits or rolls back, so other commands wait for it instead of seeing a partial
+// transaction; the rankings keep showing those files as they were until the commit.
+// If a command that changes files fails, the undo log is replayed newest first and
+// nothing is logged; a failed query (READ of a missing file, say) is only reported.
+// A transaction that is not atomic holds nothing and only defers ranking refreshes;
+// --batch runs each block of input in one.
+class Transaction : public FileHolder {
+public:
+    typedef void (*Ranker)(File* f); // Adds a file to or removes it from the rankings
+
+private:
+    // One undoable step
+    struct Undo {
+        enum Kind {CHANGED, CREATED, DELETED} kind;
+        File* file;
+        FileMark mark; // CHANGED only
+    };
+
+    std::vector<Undo> undo_log;
+    std::unordered_map<File*, std::size_t> marks; // Position of each changed file's mark in undo_log
+    std::unordered_set<File*> held;               // Files whose holder this is
+
+    // Makes this the holder of f; the caller holds f's lock, or the shard lock of a new file
+    void hold(File* f) {
+        f -> set_holder(this);
+        held.insert(f);
+    }
+
+public:
+    const bool atomic;
+    std::vector<WalRecord> records;     // Records of the commands run so far
+    std::unordered_set<File*> dirty;    // Files whose ranking keys changed
+    std::size_t commands = 0;           // Commands run so far
+    std::size_t applied = 0;            // Commands run so far that changed files and succeeded
+    std::size_t failed_at = 0;          // Command whose failure rolled the transaction back, or 0
+
+    explicit Transaction(bool is_atomic) : atomic(is_atomic) {}
+
+    Transaction(const Transaction&) = delete;
+    Transaction& operator=(const Transaction&) = delete;
+
+    // Frees the files deleted by a committed transaction
+    ~Transaction() {
+        for (const Undo& u : undo_log) {
+            if (u.kind == Undo::DELETED) delete u.file;
+        }
+    }
+
+    // Returns the transaction the calling thread is running commands for, or nullptr
+    static Transaction* current() {return static_cast<Transaction*>(FileHolder::current());}
+
+    // Scope makes a transaction the current one of the calling thread for its lifetime
+    class Scope {
+    private:
+        FileHolder* saved;
+    public:
+        explicit Scope(Transaction& t) : saved(slot()) {slot() = &t;}
+        ~Scope() {slot() = saved;}
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    };
+
+    // Records f's state before a command changes it; the caller holds f's lock
+    void changing(File* f) {
+        if (!atomic) return;
+        auto it = marks.find(f);
+        if (it == marks.end()) {
+            it = marks.emplace(f, undo_log.size()).first;
+            undo_log.push_back(Undo{Undo::CHANGED, f, f -> Mark()});
+            hold(f);
+        }
+        f -> Touch(undo_log[it -> second].mark);
+    }
+
+    // Records that f was created; the caller holds f's shard lock, so nobody has seen f yet.
+    // Returns false if the caller should rank f now (the transaction is not atomic).
+    bool created(File* f) {
+        if (!atomic) return false;
+        undo_log.push_back(Undo{Undo::CREATED, f, FileMark()});
+        hold(f);
+        return true;
+    }
+
+    // Takes over a file removed from the table (a tombstone held by this transaction if it
+    // is atomic), unlocked; returns false if the caller should free it now
+    bool deleted(File* f) {
+        dirty.erase(f);
+        if (!atomic) return false;
+        undo_log.push_back(Undo{Undo::DELETED, f, FileMark()});
+        held.insert(f);
+        return true;
+    }
+
+    // Applies the creations and deletions to the table and the rankings on commit, once the
+    // records are logged: tombstones leave the table, created files are ranked and deleted
+    // ones unranked. Refresh the dirty rankings and call release() next.
+    void publish(ShardedFileTable& table, Ranker rank, Ranker unrank) {
+        std::unordered_set<File*> created_files;
+        for (const Undo& u : undo_log) {
+            if (u.kind == Undo::CREATED) created_files.insert(u.file);
+            else if (u.kind == Undo::DELETED) {
+                table.drop(u.file);
+                if (!created_files.erase(u.file)) unrank(u.file);
+            }
+        }
+        for (File* f : created_files) rank(f);
+    }
+
+    // Undoes every change, newest first: tombstones come back to life (deleted files
+    // replaced by a created one go back into the table) and created files are removed.
+    // The rankings were never updated, so they are left alone. Call release() next.
+    void rollback(ShardedFileTable& table) {
+        for (std::size_t i = undo_log.size(); i-- > 0;) {
+            Undo& u = undo_log[i];
+            if (u.kind == Undo::CHANGED) {
+                std::lock_guard<std::mutex> guard(u.file -> mutex());
+                u.file -> Restore(u.mark);
+            }
+            else if (u.kind == Undo::DELETED) {
+                if (!table.contains(u.file)) table.put(u.file);
+                std::lock_guard<std::mutex> guard(u.file -> mutex());
+                u.file -> set_tombstone(false);
+            }
+            else {
+                File* f = table.remove(u.file -> get_filename(), [](File*) {}); // Returned locked
+                held.erase(f);
+                f -> mutex().unlock();
+                delete f;
+            }
+        }
+        undo_log.clear();
+        marks.clear();
+        records.clear();
+        dirty.clear();
+    }
+
+    // Lets go of every held file and wakes the commands waiting for them, including files
+    // already gone (created files removed by rollback)
+    void release(ShardedFileTable& table) {
+        for (File* f : held) {
+            std::lock_guard<std::mutex> guard(f -> mutex());
+            f -> set_holder(nullptr);
+        }
+        held.clear();
+        table.notify_released(this);
+    }
+};
+
+#endif // End of include guard
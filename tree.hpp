@@ -2,31 +2,76 @@
 #ifndef TREE_HPP // Prevents multiple inclusion of this header file
 #define TREE_HPP
 
+#include "rope.hpp"    // For Rope content storage
+#include "content_store.hpp" // For interning snapshotted content
+#include "content_cache.hpp" // For compressed content and its cache
+#include <memory>      // For std::shared_ptr
+#include <unordered_set> // For memory accounting
+#include "clock.hpp"   // For Clock::now
 #include <string>      // For std::string
-#include <vector>      // For std::vector
-#include <ctime>       // For std::time_t and std::time
+#include <utility>     // For std::move
 #include <stdexcept>   // For exception handling
 
-// TreeNode class represents a node in a version tree
+class CheckpointIO; // Restores nodes from checkpoints (storage.hpp)
+
+// VersionState is a detached copy of what a version holds: its content (shared, not
+// copied), snapshot message and timestamps. It stays valid after the version's file is
+// unlocked, so it can be carried over to another file (see CLONE).
+struct VersionState {
+    Rope content;
+    std::shared_ptr<const PackedContent> packed; // Compressed content instead of `content`, or null
+    std::string message;
+    Clock::time_point created;
+    Clock::time_point snapshotted;               // 0 if not snapshotted
+};
+
+// TreeNode class represents a node in a version tree. Nodes are allocated from their
+// file's arena (see arena.hpp), which owns them, so a node never frees other nodes.
+// Children form a singly linked list (first_child / next_sibling), newest first.
+// A merge version (see File::Merge) also records a second parent, the version merged into
+// its first one; parent, depth, jumps and snapshot links all follow first parents only.
+// Each node also keeps its depth and one jump pointer to an ancestor, chosen on insertion
+// so that any ancestor (and so the lowest common ancestor of two nodes) is reached in
+// O(log depth) steps: the jump targets follow a skew-binary pattern (Myers, 1983).
 class TreeNode {
 private:
+    friend class CheckpointIO;
+
     int version_id;                    // Unique identifier for the version
-    std::string content;               // Content stored in this version
+    Rope content;                      // Content stored in this version (empty while packed)
+    std::shared_ptr<const PackedContent> packed; // Compressed content of a cold snapshot, or null
     std::string message;               // Snapshot message
-    std::time_t created_timestamp;     // Timestamp when node was created
-    std::time_t snapshot_timestamp;    // Timestamp when node was snapshotted (0 if not snapshotted)
+    Clock::time_point created_timestamp;  // Timestamp when node was created
+    Clock::time_point snapshot_timestamp; // Timestamp when node was snapshotted (0 if not snapshotted)
+    Clock::time_point last_read;          // Timestamp of the last READ (creation time if never read)
     TreeNode* parent;                  // Pointer to parent node
-    std::vector<TreeNode*> children;   // List of child nodes
+    TreeNode* merge_parent;            // Second parent of a merge version (nullptr otherwise)
+    bool merged;                       // This node or a first-parent ancestor has a second parent
+    TreeNode* snapshot_parent;         // Nearest snapshotted strict ancestor (nullptr at root)
+    int snapshot_depth;                // Number of snapshotted strict ancestors
+    TreeNode* first_child;             // Most recently added child (nullptr if none)
+    TreeNode* next_sibling;            // Next older child of the same parent
+    int depth;                         // Number of strict ancestors
+    TreeNode* jump;                    // Ancestor to skip to (the root points to itself)
 
 public:
     // Constructor: initializes a TreeNode with given version_id, content, and optional parent
-    TreeNode(int version_id, const std::string& content = "", TreeNode* parent = nullptr)
+    TreeNode(int version_id, Rope content = Rope(), TreeNode* parent = nullptr)
         : version_id(version_id),
-          content(content),
+          content(std::move(content)),
           message(""),
-          created_timestamp(std::time(nullptr)),
+          created_timestamp(Clock::now()),
           snapshot_timestamp(0),
-          parent(nullptr) // add_child will set this
+          last_read(created_timestamp),
+          parent(nullptr), // add_child will set this
+          merge_parent(nullptr),
+          merged(false),
+          snapshot_parent(nullptr),
+          snapshot_depth(0),
+          first_child(nullptr),
+          next_sibling(nullptr),
+          depth(0),
+          jump(this)
     {
         if (version_id < 0) {
             throw std::invalid_argument("Version ID must be non-negative"); // Ensure valid version_id
@@ -40,30 +85,125 @@ public:
     TreeNode(const TreeNode&) = delete;
     TreeNode& operator=(const TreeNode&) = delete;
 
-    // Destructor: deletes all child nodes recursively
-    ~TreeNode() {
-        for (auto* c : children) {delete c;}
-    }
-
     // Getters for private members
     int get_version_id() const {return version_id;} // Returns version_id
-    const std::string& get_content() const {return content;} // Returns content
+    // Returns the content, decompressing it (through the cache) if the version is packed
+    Rope get_content() const {return packed ? ContentCache::instance().get(packed) : content;}
+    // Returns the content and records the read for the compactor
+    Rope read_content() {
+        last_read = Clock::now();
+        return get_content();
+    }
+    std::size_t content_size() const {return packed ? packed -> raw_size : content.size();} // Returns content length
+    bool is_packed() const {return packed != nullptr;} // Checks if content is compressed
+    Clock::time_point get_last_read() const {return last_read;} // Returns last read timestamp
     const std::string& get_message() const {return message;} // Returns snapshot message
-    std::time_t get_created_time() const {return created_timestamp;} // Returns creation timestamp
-    std::time_t get_snapshot_time() const {
+    Clock::time_point get_created_time() const {return created_timestamp;} // Returns creation timestamp
+    Clock::time_point get_snapshot_time() const {
         if (!is_snapshot()) {throw std::logic_error("Version has not been snapshotted");}
         return snapshot_timestamp; // Returns snapshot timestamp if snapshotted
     }
     bool is_snapshot() const {return snapshot_timestamp != 0;} // Checks if node is snapshotted
     TreeNode* get_parent() const {return parent;} // Returns parent node pointer
-    const std::vector<TreeNode*>& get_children() const {return children;} // Returns children vector
+    TreeNode* get_merge_parent() const {return merge_parent;} // Returns the second parent of a merge version
+    bool has_merged_ancestry() const {return merged;} // Checks if some ancestor is only reached through a second parent
+    TreeNode* get_snapshot_parent() const {return snapshot_parent;} // Returns nearest snapshotted ancestor
+    int get_snapshot_depth() const {return snapshot_depth;} // Returns number of snapshotted ancestors
+    TreeNode* get_first_child() const {return first_child;} // Returns the newest child
+    TreeNode* get_next_sibling() const {return next_sibling;} // Returns the next older sibling
+    int get_depth() const {return depth;} // Returns the number of strict ancestors
+
+    // Returns the ancestor at the given depth (this node if d is its own depth). O(log depth).
+    const TreeNode* ancestor_at(int d) const {
+        if (d < 0 || d > depth) throw std::out_of_range("No ancestor at that depth");
+        const TreeNode* n = this;
+        while (n -> depth > d) n = n -> jump -> depth >= d ? n -> jump : n -> parent;
+        return n;
+    }
+
+    // Returns the lowest common ancestor of a and b, which must be in the same tree. O(log depth).
+    static const TreeNode* common_ancestor(const TreeNode* a, const TreeNode* b) {
+        if (a -> depth > b -> depth) a = a -> ancestor_at(b -> depth);
+        else if (b -> depth > a -> depth) b = b -> ancestor_at(a -> depth);
+        while (a != b) { // Equal depths have equal jump depths, so both sides move in step
+            if (a -> jump != b -> jump) {a = a -> jump; b = b -> jump;}
+            else {a = a -> parent; b = b -> parent;}
+        }
+        return a;
+    }
+
+    // Calls fn on every child, newest first
+    template <typename Fn>
+    void for_each_child(Fn fn) const {
+        for (TreeNode* c = first_child; c; c = c -> next_sibling) {fn(c);}
+    }
 
     // Adds a child node to this node
     void add_child(TreeNode* child) {
         if (!child) throw std::invalid_argument("child is null"); // Ensure child is not null
         if (child -> parent == this) return; // Already added
         child -> parent = this; // Set child's parent pointer
-        children.push_back(child); // Add child to children vector
+        // Children are only created under snapshotted (immutable) nodes, so these stay valid
+        child -> snapshot_parent = is_snapshot() ? this : snapshot_parent;
+        child -> snapshot_depth = snapshot_depth + (is_snapshot() ? 1 : 0);
+        child -> next_sibling = first_child; // Prepend to the child list
+        first_child = child;
+        child -> merged = merged;
+        child -> depth = depth + 1;
+        // Skip two equal jumps at once, otherwise step to the parent
+        bool merge = depth - jump -> depth == jump -> depth - jump -> jump -> depth;
+        child -> jump = merge ? jump -> jump : this;
+    }
+
+    // Records the second parent of a merge version; must be set before it has children
+    void set_merge_parent(TreeNode* second) {
+        if (!second || second == parent) throw std::invalid_argument("A merge needs two distinct parents");
+        if (first_child) throw std::logic_error("Second parent set after children were added");
+        merge_parent = second;
+        merged = true;
+    }
+
+    // Moves the content, message and timestamps of another node into this one, leaving
+    // its links alone (used when a file's surviving versions are moved to a new arena)
+    void take_state(TreeNode& old) {
+        content = std::move(old.content);
+        packed = std::move(old.packed);
+        message = std::move(old.message);
+        created_timestamp = old.created_timestamp;
+        snapshot_timestamp = old.snapshot_timestamp;
+        last_read = old.last_read;
+    }
+
+    // Returns a copy of this node's content, message and timestamps. O(1).
+    VersionState state() const {
+        return VersionState{content, packed, message, created_timestamp, snapshot_timestamp};
+    }
+
+    // Makes this node hold the given state, sharing its content. A snapshotted state's
+    // content is interned, which is O(1) when it already was.
+    void set_state(const VersionState& s) {
+        content = s.snapshotted && !s.packed ? ContentStore::instance().intern(s.content) : s.content;
+        packed = s.packed;
+        message = s.message;
+        created_timestamp = s.created;
+        snapshot_timestamp = s.snapshotted;
+    }
+
+    // Replaces the content of a snapshotted node with its compressed form
+    void pack(std::shared_ptr<const PackedContent> p) {
+        if (!is_snapshot()) throw std::logic_error("Only snapshotted versions can be compressed");
+        packed = std::move(p);
+        content.clear();
+    }
+
+    // Adds the bytes this node's content keeps alive to used and allocated (shared data
+    // counted once, see Rope::account)
+    void account(std::unordered_set<const void*>& seen, std::size_t& used, std::size_t& allocated) const {
+        if (!packed) content.account(seen, used, allocated);
+        else if (seen.insert(packed.get()).second) {
+            used += packed -> bytes.size();
+            allocated += sizeof(PackedContent) + packed -> bytes.capacity();
+        }
     }
 
     // Updates the content of this node if not snapshotted
@@ -71,15 +211,26 @@ public:
         if (is_snapshot()) {
             throw std::logic_error("Version has been snapshotted, can't update content");
         }
-        content = new_content;
+        content.clear();
+        content.append(new_content);
+    }
+
+    // Appends to the content of this node if not snapshotted
+    void append_content(const std::string& extra) {
+        if (is_snapshot()) {
+            throw std::logic_error("Version has been snapshotted, can't update content");
+        }
+        content.append(extra);
     }
 
-    // Snapshots this node with a message
+    // Snapshots this node with a message. The content is now immutable, so it is interned:
+    // if another version already holds the same bytes, this one shares them.
     void snapshot(const std::string& msg) {
         if (is_snapshot()) {throw std::logic_error("Version already snapshotted");}
         if (msg.empty()) {throw std::invalid_argument("Message can't be empty");}
+        content = ContentStore::instance().intern(content);
         message = msg;
-        snapshot_timestamp = std::time(nullptr); // Set snapshot timestamp
+        snapshot_timestamp = Clock::now(); // Set snapshot timestamp
     }
 };
 